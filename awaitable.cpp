@@ -0,0 +1,47 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "awaitable.h"
+#include "event_loop.h"
+
+namespace tuxlike {
+
+SpawnAwaitable SpawnAwaitable::with_timeout(std::chrono::nanoseconds timeout) && {
+    m_job.m_timeout_ns = duration_ns(timeout);
+    return std::move(*this);
+}
+
+void SpawnAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    EventLoop& loop = m_supervisor.loop();
+    m_supervisor.submit(std::move(m_job),
+        [this, &loop, handle](size_t, const JobResult& result) {
+            m_result = result;
+            // Not from within the supervisor, which is still busy
+            // with the job and holds the lock of the reports.
+            loop.post([handle]() {
+                handle.resume();
+            });
+        });
+}
+
+} // namespace tuxlike
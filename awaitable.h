@@ -0,0 +1,96 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef AWAITABLE_H
+#define AWAITABLE_H
+
+#include <chrono>
+#include <coroutine>
+#include <string>
+#include <vector>
+
+#include "job.h"
+#include "supervisor.h"
+
+namespace tuxlike {
+
+/**
+ * Runs a job when awaited and resumes the awaiting coroutine with its
+ * `JobResult` once the job is done:
+ *
+ *     std::vector<std::string> argv{"make", "test"};
+ *     JobResult result = co_await spawn(supervisor, argv)
+ *         .with_timeout(std::chrono::milliseconds(500));
+ *
+ * (GCC 12 rejects a braced argument list right inside `co_await`.)
+ *
+ * The job is supervised by the `Supervisor` like any other, which
+ * watches its pidfd and deadline in the event loop of the thread that
+ * calls `Supervisor::run_once`. Any number of coroutines may wait for
+ * their jobs without a thread of their own; `m_parallel` of the
+ * options of the supervisor limits how many jobs run at a time.
+ *
+ * The coroutine is resumed from `Supervisor::run_once`, after the
+ * handlers of that round, so it may await further jobs right away.
+ */
+class SpawnAwaitable {
+public:
+
+    SpawnAwaitable(Supervisor& supervisor, Job job)
+        : m_supervisor(supervisor), m_job(std::move(job)) {}
+
+    /// Gives the job a time limit; it has none by default.
+    SpawnAwaitable with_timeout(std::chrono::nanoseconds timeout) &&;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    JobResult await_resume() const noexcept { return m_result; }
+
+private:
+
+    Supervisor& m_supervisor;
+    Job m_job;
+    JobResult m_result;
+};
+
+/**
+ * Prepares `argv[0]` (searched in `PATH`) to run once awaited, see
+ * `SpawnAwaitable`.
+ */
+inline SpawnAwaitable spawn(Supervisor& supervisor,
+    std::vector<std::string> argv) {
+
+    Job job;
+    job.m_argv = std::move(argv);
+    return SpawnAwaitable(supervisor, std::move(job));
+}
+
+inline SpawnAwaitable spawn(Supervisor& supervisor, Job job) {
+    return SpawnAwaitable(supervisor, std::move(job));
+}
+
+} // namespace tuxlike
+
+#endif // AWAITABLE_H
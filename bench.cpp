@@ -0,0 +1,274 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <thread>
+#include <unistd.h>
+
+#include "bench.h"
+
+/// Every allocation of the process, counted by the operator new below.
+static std::atomic<size_t> g_allocations(0);
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+namespace tuxlike {
+
+size_t allocation_count() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+void write_json_string(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out << escape;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void write_json_context(std::ostream& out) {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"host_name\": ";
+    write_json_string(out, host);
+    out << ",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n";
+}
+
+
+
+Bench::Bench(uint64_t min_ns, const std::string& filter, std::ostream& table)
+    : m_min_ns(min_ns), m_filter(filter), m_table(table) {}
+
+bool Bench::selected(const std::string& name) const {
+    return name.find(m_filter) != name.npos;
+}
+
+const std::vector<BenchResult>& Bench::results() const {
+    return m_results;
+}
+
+void Bench::add(BenchResult result, std::vector<double> ns) {
+    std::sort(ns.begin(), ns.end());
+    result.m_ns = ns[ns.size() / 2];
+    result.m_min_ns = ns.front();
+
+    char line[256];
+    int length = snprintf(line, sizeof(line), "%-44s %10.1f ns %8.2f allocs",
+        result.m_name.c_str(), result.m_ns, result.m_allocations);
+    if (result.m_items > 0 && length > 0 && (size_t) length < sizeof(line)) {
+        snprintf(line + length, sizeof(line) - length, " %10.1f M%s/s",
+            result.m_items * 1000.0 / result.m_ns, result.m_unit.c_str());
+    }
+    m_table << line << std::endl;
+    m_results.push_back(std::move(result));
+}
+
+void Bench::write_json(std::ostream& out) const {
+    out << "{\n";
+    write_json_context(out);
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < m_results.size(); i++) {
+        const BenchResult& result = m_results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"name\": ";
+        write_json_string(out, result.m_name);
+        out << ",\n";
+        out << "      \"iterations\": " << result.m_iterations << ",\n";
+        out << "      \"repetitions\": " << REPETITIONS << ",\n";
+        out << "      \"real_time\": " << result.m_ns << ",\n";
+        out << "      \"min_time\": " << result.m_min_ns << ",\n";
+        out << "      \"time_unit\": \"ns\",\n";
+        out << "      \"allocations_per_iteration\": "
+            << result.m_allocations;
+        if (result.m_items > 0) {
+            out << ",\n      \"items_per_second\": "
+                << result.m_items * 1e9 / result.m_ns << ",\n";
+            out << "      \"item_unit\": ";
+            write_json_string(out, result.m_unit);
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+
+
+/// The percentiles every `Latencies` reports.
+static const struct {
+    const char* m_name;
+    double m_percent;
+} PERCENTILES[] = {
+    { "p50",   50 },
+    { "p90",   90 },
+    { "p99",   99 },
+    { "p99.9", 99.9 },
+};
+
+Latencies::Latencies(const std::string& name)
+    : m_name(name), m_sorted(true) {}
+
+const std::string& Latencies::name() const {
+    return m_name;
+}
+
+void Latencies::add(uint64_t ns) {
+    m_samples.push_back(ns);
+    m_sorted = false;
+}
+
+size_t Latencies::count() const {
+    return m_samples.size();
+}
+
+uint64_t Latencies::percentile(double percent) {
+    if (!m_sorted) {
+        std::sort(m_samples.begin(), m_samples.end());
+        m_sorted = true;
+    }
+    size_t rank = (size_t) std::ceil(percent / 100 * m_samples.size());
+    return m_samples[std::clamp<size_t>(rank, 1, m_samples.size()) - 1];
+}
+
+std::vector<size_t> Latencies::histogram() const {
+    std::vector<size_t> buckets;
+    for (uint64_t ns : m_samples) {
+        size_t bucket = 0;
+        while (bucket < 63 && (1ULL << bucket) < ns) {
+            bucket++;
+        }
+        if (buckets.size() <= bucket) {
+            buckets.resize(bucket + 1, 0);
+        }
+        buckets[bucket]++;
+    }
+    return buckets;
+}
+
+void Latencies::write_table(std::ostream& out) {
+    if (m_samples.empty()) {
+        out << m_name << ": no samples" << std::endl;
+        return;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%s: %zu samples, min %.1f us",
+        m_name.c_str(), m_samples.size(), percentile(0) / 1e3);
+    out << line;
+    for (const auto& percentile : PERCENTILES) {
+        snprintf(line, sizeof(line), ", %s %.1f us", percentile.m_name,
+            this->percentile(percentile.m_percent) / 1e3);
+        out << line;
+    }
+    snprintf(line, sizeof(line), ", max %.1f us", percentile(100) / 1e3);
+    out << line << std::endl;
+
+    std::vector<size_t> buckets = histogram();
+    size_t first = 0;
+    while (buckets[first] == 0) {
+        first++;
+    }
+    size_t cumulative = 0;
+    for (size_t bucket = first; bucket < buckets.size(); bucket++) {
+        cumulative += buckets[bucket];
+        double share = (double) buckets[bucket] / m_samples.size();
+        std::string bar((size_t) (share * 40 + 0.5), '#');
+        snprintf(line, sizeof(line), "  <= %10.1f us |%-40s| %6.2f%% %7.2f%%",
+            (1ULL << bucket) / 1e3, bar.c_str(), share * 100,
+            cumulative * 100.0 / m_samples.size());
+        out << line << std::endl;
+    }
+}
+
+void Latencies::write_json(std::ostream& out) {
+    out << "    {\n";
+    out << "      \"name\": ";
+    write_json_string(out, m_name);
+    out << ",\n";
+    out << "      \"time_unit\": \"ns\",\n";
+    out << "      \"count\": " << m_samples.size();
+    if (!m_samples.empty()) {
+        out << ",\n      \"min\": " << percentile(0);
+        for (const auto& percentile : PERCENTILES) {
+            out << ",\n      \"" << percentile.m_name << "\": "
+                << this->percentile(percentile.m_percent);
+        }
+        out << ",\n      \"max\": " << percentile(100);
+
+        // Buckets by their upper bound, as Prometheus has them.
+        std::vector<size_t> buckets = histogram();
+        out << ",\n      \"histogram\": [";
+        const char* separator = "";
+        for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+            if (buckets[bucket] != 0) {
+                out << separator << "{ \"le\": " << (1ULL << bucket)
+                    << ", \"count\": " << buckets[bucket] << " }";
+                separator = ", ";
+            }
+        }
+        out << "]";
+    }
+    out << "\n    }";
+}
+
+} // namespace tuxlike
@@ -0,0 +1,215 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace tuxlike {
+
+/**
+ * How many allocations the process made so far.
+ *
+ * bench.cpp replaces the global operator new to count them, so any
+ * program linked with it counts.
+ */
+size_t allocation_count();
+
+/**
+ * Writes the string as a JSON string, with quotes.
+ */
+void write_json_string(std::ostream& out, const std::string& text);
+
+/**
+ * Writes the `"context"` member of a JSON report, with the time, the
+ * host and how the benchmark was built, and a comma after it.
+ */
+void write_json_context(std::ostream& out);
+
+/**
+ * What one benchmark measured, per iteration.
+ */
+struct BenchResult {
+
+    std::string m_name;
+
+    /// Iterations of every repetition.
+    uint64_t m_iterations = 0;
+
+    /// The median and the fastest of the repetitions, in nanoseconds.
+    double m_ns = 0;
+    double m_min_ns = 0;
+
+    double m_allocations = 0;
+
+    /// What one iteration got through, such as characters, or 0.
+    double m_items = 0;
+    std::string m_unit;
+};
+
+/**
+ * A minimal benchmark harness: runs every selected benchmark in
+ * batches until a batch takes the minimum time, repeats that a few
+ * times and keeps the median.
+ */
+class Bench {
+public:
+
+    /**
+     * \param[in] min_ns how long a repetition should take at least.
+     * \param[in] filter if not empty, only benchmarks whose name
+     *            contains it are run.
+     * \param[out] table receives a line per result as it comes.
+     */
+    Bench(uint64_t min_ns, const std::string& filter, std::ostream& table);
+
+    /**
+     * Measures `run`, which does one iteration and returns how many
+     * `unit` it got through, and prints the result.
+     */
+    template<typename Run>
+    void measure(const std::string& name, const char* unit, Run run);
+
+    const std::vector<BenchResult>& results() const;
+
+    /**
+     * Writes the results as a JSON object, with the names of the
+     * fields of Google Benchmark where they mean the same.
+     */
+    void write_json(std::ostream& out) const;
+
+private:
+
+    /// Repetitions of every benchmark.
+    static const int REPETITIONS = 5;
+
+    bool selected(const std::string& name) const;
+
+    void add(BenchResult result, std::vector<double> ns);
+
+    uint64_t m_min_ns;
+    std::string m_filter;
+    std::ostream& m_table;
+    std::vector<BenchResult> m_results;
+};
+
+
+/**
+ * A distribution of latencies in nanoseconds, reported as percentiles
+ * and as a histogram with a bucket per power of two.
+ */
+class Latencies {
+public:
+
+    explicit Latencies(const std::string& name);
+
+    const std::string& name() const;
+
+    void add(uint64_t ns);
+
+    size_t count() const;
+
+    /**
+     * The latency that `percent` of the samples do not exceed, by the
+     * nearest rank; there must be samples.
+     */
+    uint64_t percentile(double percent);
+
+    /// Writes the percentiles and the histogram as text.
+    void write_table(std::ostream& out);
+
+    /// Writes the percentiles and the histogram as a JSON object.
+    void write_json(std::ostream& out);
+
+private:
+
+    /// How many samples fall into each bucket: up to 1, 2, 4... ns.
+    std::vector<size_t> histogram() const;
+
+    std::string m_name;
+    std::vector<uint64_t> m_samples;
+    bool m_sorted;
+};
+
+
+
+template<typename Run>
+void Bench::measure(const std::string& name, const char* unit, Run run) {
+    if (!selected(name)) {
+        return;
+    }
+
+    // Double the iterations until a batch takes long enough.
+    uint64_t items = 0;
+    uint64_t iterations = 1;
+    for (;;) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            items += run();
+        }
+        std::chrono::nanoseconds elapsed =
+            std::chrono::steady_clock::now() - start;
+        if ((uint64_t) elapsed.count() >= m_min_ns / 4) {
+            double factor = (double) m_min_ns / std::max<int64_t>(
+                elapsed.count(), 1);
+            iterations = std::max<uint64_t>(iterations,
+                (uint64_t) (iterations * factor));
+            break;
+        }
+        iterations *= 2;
+    }
+
+    BenchResult result;
+    result.m_name = name;
+    result.m_iterations = iterations;
+    result.m_unit = unit;
+    // Reserved before counting, so that only `run` allocates.
+    std::vector<double> ns;
+    ns.reserve(REPETITIONS);
+    size_t allocations = allocation_count();
+    items = 0;
+    for (int repetition = 0; repetition < REPETITIONS; repetition++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            items += run();
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        ns.push_back(elapsed.count() / iterations);
+    }
+    double total = (double) iterations * REPETITIONS;
+    result.m_allocations = (allocation_count() - allocations) / total;
+    result.m_items = items / total;
+    add(std::move(result), std::move(ns));
+}
+
+} // namespace tuxlike
+
+#endif // BENCH_H
@@ -0,0 +1,323 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+namespace tuxlike {
+
+/// Bytes a sink buffers before a worker that brings more waits for the
+/// writer; bounds the memory a stalled destination can take.
+#define SINK_BUFFER_LIMIT (4 << 20)
+
+/**
+ * Whether a splice into the descriptor can be kept from blocking:
+ * SPLICE_F_NONBLOCK covers a pipe, and a regular file does not wait
+ * for a reader.
+ */
+static bool splices_without_blocking(int fd) {
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0
+        && (S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode));
+}
+
+Sink::Sink(int fd)
+    : m_fd(fd), m_splice(splices_without_blocking(fd)), m_writing(false),
+      m_stopping(false), m_error(0) {}
+
+Sink::~Sink() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+}
+
+int Sink::write_all(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(m_fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                // Somebody made our output non-blocking.
+                struct pollfd pfd = { m_fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return errno;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+int Sink::move_from(int pipe_fd, size_t length) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_error != 0) {
+        return m_error;
+    }
+
+    // Straight into the destination while that keeps the order and
+    // does not block; what is left goes to the writer.
+    while (length > 0 && m_splice && m_pending.empty() && !m_writing) {
+        ssize_t moved = splice(pipe_fd, NULL, m_fd, NULL, length,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            length -= moved;
+        } else if (moved == 0) {
+            // The pipe ended.
+            return 0;
+        } else if (errno == EINVAL) {
+            m_splice = false;
+        } else if (errno == EAGAIN) {
+            break;
+        } else if (errno != EINTR) {
+            return errno;
+        }
+    }
+    if (length == 0) {
+        return 0;
+    }
+    return queue_from(pipe_fd, length, lock);
+}
+
+/**
+ * Reads the bytes from the pipe into `m_pending` for the writer.
+ */
+int Sink::queue_from(int pipe_fd, size_t length,
+    std::unique_lock<std::mutex>& lock)
+{
+    m_changed.wait(lock, [this]() {
+        return m_pending.size() < SINK_BUFFER_LIMIT || m_error != 0;
+    });
+    if (m_error != 0) {
+        return m_error;
+    }
+    if (!m_writer.joinable()) {
+        m_writer = std::thread(&Sink::write_pending, this);
+    }
+
+    size_t start = m_pending.size();
+    m_pending.resize(start + length);
+    size_t queued = 0;
+    int error = 0;
+    while (queued < length) {
+        ssize_t got = read(pipe_fd, &m_pending[start + queued],
+            length - queued);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            // An end of the pipe is no error.
+            error = got < 0 ? errno : 0;
+            break;
+        }
+        queued += got;
+    }
+    m_pending.resize(start + queued);
+    m_changed.notify_all();
+    return error;
+}
+
+void Sink::write_pending() {
+    std::string chunk;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_changed.wait(lock, [this]() {
+            return !m_pending.empty() || m_stopping;
+        });
+        if (m_pending.empty()) {
+            return;
+        }
+
+        chunk.clear();
+        chunk.swap(m_pending);
+        m_writing = true;
+        lock.unlock();
+        int error = write_all(chunk.data(), chunk.size());
+        lock.lock();
+        m_writing = false;
+        if (error != 0 && m_error == 0) {
+            m_error = error;
+        }
+        // Workers may be waiting for room.
+        m_changed.notify_all();
+    }
+}
+
+
+
+TailSink::TailSink(size_t capacity)
+    : Sink(-1), m_ring(capacity), m_total(0) {}
+
+int TailSink::move_from(int pipe_fd, size_t length) {
+    size_t capacity = m_ring.size();
+    while (length > 0) {
+        // Read straight into the ring, overwriting the oldest bytes.
+        size_t position = m_total % capacity;
+        size_t chunk = capacity - position;
+        if (chunk > length) {
+            chunk = length;
+        }
+        ssize_t got = read(pipe_fd, &m_ring[position], chunk);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (got == 0) {
+            // The pipe ended.
+            return 0;
+        }
+        m_total += got;
+        length -= got;
+    }
+    return 0;
+}
+
+std::string TailSink::contents() const {
+    size_t capacity = m_ring.size();
+    if (m_total <= capacity) {
+        return std::string(m_ring.data(), m_total);
+    }
+    size_t position = m_total % capacity;
+    std::string contents(m_ring.data() + position, capacity - position);
+    contents.append(m_ring.data(), position);
+    return contents;
+}
+
+
+
+OutputPump::OutputPump() {
+    m_pipe[0] = -1;
+    m_pipe[1] = -1;
+}
+
+OutputPump::~OutputPump() {
+    for (int fd : m_pipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    for (int fd : m_scratch) {
+        close(fd);
+    }
+}
+
+int OutputPump::open(const std::vector<Sink*>& sinks) {
+    m_sinks = sinks;
+    if (pipe2(m_pipe, O_CLOEXEC) < 0) {
+        return errno;
+    }
+    int size = sinks.size() > 1 ? fcntl(m_pipe[0], F_GETPIPE_SZ) : 0;
+    if (size < 0) {
+        return errno;
+    }
+    for (size_t i = 1; i < sinks.size(); i++) {
+        int scratch[2];
+        if (pipe2(scratch, O_CLOEXEC) < 0) {
+            return errno;
+        }
+        m_scratch.push_back(scratch[0]);
+        m_scratch.push_back(scratch[1]);
+        // As large as the pipe of the child, so that it takes a tee of
+        // all the child's pipe holds.
+        if (fcntl(scratch[1], F_SETPIPE_SZ, size) < 0) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+void OutputPump::close_write() {
+    if (m_pipe[1] >= 0) {
+        close(m_pipe[1]);
+        m_pipe[1] = -1;
+    }
+}
+
+bool OutputPump::empty() const {
+    int available = 0;
+    return ioctl(m_pipe[0], FIONREAD, &available) < 0 || available == 0;
+}
+
+int OutputPump::pump() {
+    for (;;) {
+        int available = 0;
+        if (ioctl(m_pipe[0], FIONREAD, &available) < 0) {
+            return errno;
+        }
+        if (available == 0) {
+            return 0;
+        }
+        size_t length = available;
+
+        if (m_sinks.empty()) {
+            char buffer[16384];
+            ssize_t ignored = read(m_pipe[0], buffer,
+                length < sizeof(buffer) ? length : sizeof(buffer));
+            (void) ignored;
+            continue;
+        }
+
+        // Duplicate the data for the other sinks, without consuming it.
+        // Every round empties the scratch pipes, which are as large as
+        // ours, so each takes all of it; anything else would leave some
+        // sink behind the others.
+        for (size_t i = 1; i < m_sinks.size(); i++) {
+            ssize_t copied = tee(m_pipe[0], m_scratch[2 * i - 1], length, 0);
+            if (copied < 0) {
+                return errno;
+            }
+            if ((size_t) copied != length) {
+                return EIO;
+            }
+        }
+        for (size_t i = 1; i < m_sinks.size(); i++) {
+            int error = m_sinks[i]->move_from(m_scratch[2 * i - 2], length);
+            if (error != 0) {
+                return error;
+            }
+        }
+
+        int error = m_sinks[0]->move_from(m_pipe[0], length);
+        if (error != 0) {
+            return error;
+        }
+    }
+}
+
+} // namespace tuxlike
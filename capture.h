@@ -0,0 +1,183 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tuxlike {
+
+/**
+ * A destination of captured output: our stdout or stderr, or a log.
+ *
+ * A sink is shared by all workers, so writes are serialised, but a
+ * worker never waits for a slow destination. Into a regular file or a
+ * pipe, data is moved with a non-blocking splice() while nothing is
+ * queued for it. Whatever does not fit, and all data for other
+ * destinations (a terminal or a socket, for one), is read into a
+ * buffer which a thread of the sink writes out.
+ */
+class Sink {
+public:
+
+    /// Takes the descriptor, but does not own it.
+    explicit Sink(int fd);
+
+    /// Writes out what is still buffered.
+    virtual ~Sink();
+
+    Sink(const Sink&) = delete;
+    Sink& operator=(const Sink&) = delete;
+
+    /**
+     * Moves `length` bytes, which the pipe already holds, from the
+     * pipe into the sink, or less if the pipe ends before.
+     *
+     * Only waits for the destination if the sink has buffered
+     * `SINK_BUFFER_LIMIT` bytes for it already.
+     *
+     * \return 0 on success, or the `errno` describing the failure,
+     *         which may be that of an earlier write.
+     */
+    virtual int move_from(int pipe_fd, size_t length);
+
+private:
+
+    int queue_from(int pipe_fd, size_t length,
+        std::unique_lock<std::mutex>& lock);
+
+    /// The thread that writes `m_pending` out.
+    void write_pending();
+
+    int write_all(const char* data, size_t length);
+
+    int m_fd;
+    bool m_splice;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+
+    /// Read from pipes, waiting to be written out.
+    std::string m_pending;
+
+    /// Whether the writer is writing out what it took from `m_pending`.
+    bool m_writing;
+
+    bool m_stopping;
+
+    /// The first error of the writer.
+    int m_error;
+
+    /// Started with the first bytes it has to write.
+    std::thread m_writer;
+};
+
+/**
+ * A sink that keeps only the last bytes of the output, in a ring of
+ * fixed size, no matter how much the child writes.
+ *
+ * A tail belongs to a single job and is only touched by the thread
+ * of its worker, so it needs no locking.
+ */
+class TailSink : public Sink {
+public:
+
+    explicit TailSink(size_t capacity);
+
+    int move_from(int pipe_fd, size_t length) override;
+
+    /// The bytes kept, oldest first.
+    std::string contents() const;
+
+    /// How many bytes went through the sink in total.
+    uint64_t total() const { return m_total; }
+
+private:
+
+    std::vector<char> m_ring;
+    uint64_t m_total;
+};
+
+/**
+ * Carries one output stream of a child (stdout or stderr) through
+ * a pipe into any number of sinks.
+ *
+ * The bytes never pass through user space: tee() duplicates them into
+ * a scratch pipe for every sink but the first one, and splice() moves
+ * them into the sinks.
+ */
+class OutputPump {
+public:
+
+    OutputPump();
+    ~OutputPump();
+
+    OutputPump(const OutputPump&) = delete;
+    OutputPump& operator=(const OutputPump&) = delete;
+
+    /**
+     * Creates the pipes. All descriptors are close-on-exec.
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int open(const std::vector<Sink*>& sinks);
+
+    /// The end the event loop watches.
+    int read_fd() const { return m_pipe[0]; }
+
+    /// The end the child writes into.
+    int write_fd() const { return m_pipe[1]; }
+
+    /// Closes our copy of the write end, once the child has its own.
+    void close_write();
+
+    /**
+     * Moves whatever the pipe holds right now into the sinks.
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int pump();
+
+    /// Whether the pipe is empty; after EPOLLHUP this means EOF.
+    bool empty() const;
+
+private:
+
+    int m_pipe[2];
+    std::vector<Sink*> m_sinks;
+
+    /// A pipe for every sink but the first, `m_scratch[2 * i]` is
+    /// the read end of the one for `m_sinks[i + 1]`.
+    std::vector<int> m_scratch;
+};
+
+} // namespace tuxlike
+
+#endif // CAPTURE_H
@@ -0,0 +1,221 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+
+namespace tuxlike {
+
+bool own_cgroup(std::string& path) {
+    std::string mount_point;
+    std::ifstream mounts("/proc/self/mounts");
+    std::string device, directory, type, rest;
+    while (mounts >> device >> directory >> type
+            && std::getline(mounts, rest)) {
+        if (type == "cgroup2") {
+            mount_point = directory;
+            break;
+        }
+    }
+    if (mount_point.empty()) {
+        return false;
+    }
+
+    // The unified hierarchy has the ID 0 and no controller list.
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            path = mount_point + line.substr(3);
+            if (path.size() > 1 && path.back() == '/') {
+                path.pop_back();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Reads a small control file at once.
+ */
+static bool read_control(const std::string& path, std::string& content) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[4096];
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    if (got < 0) {
+        return false;
+    }
+    content.assign(buffer, got);
+    return true;
+}
+
+static int write_control(const std::string& path, const char* value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    int error = 0;
+    if (write(fd, value, strlen(value)) < 0) {
+        error = errno;
+    }
+    close(fd);
+    return error;
+}
+
+
+
+Cgroup::Cgroup()
+    : m_procs_fd(-1), m_events_fd(-1) {}
+
+Cgroup::~Cgroup() {
+    if (m_procs_fd >= 0) {
+        close(m_procs_fd);
+    }
+    if (m_events_fd >= 0) {
+        close(m_events_fd);
+    }
+    if (!m_path.empty()) {
+        rmdir(m_path.c_str());
+    }
+}
+
+int Cgroup::create(const std::string& parent, const std::string& name) {
+    std::string path = parent + "/" + name;
+    if (mkdir(path.c_str(), 0755) < 0) {
+        return errno;
+    }
+    m_path = path;
+
+    m_procs_fd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (m_procs_fd < 0) {
+        return errno;
+    }
+    m_events_fd = open((path + "/cgroup.events").c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_events_fd < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+bool Cgroup::populated() const {
+    // Reading through the watched descriptor also acknowledges the
+    // change notified by EPOLLPRI, so the event does not repeat.
+    char buffer[256];
+    ssize_t got = pread(m_events_fd, buffer, sizeof(buffer) - 1, 0);
+    if (got < 0) {
+        return false;
+    }
+    buffer[got] = '\0';
+    return strstr(buffer, "populated 1") != NULL;
+}
+
+int Cgroup::set(const char* file, const std::string& value) const {
+    return write_control(m_path + "/" + file, value.c_str());
+}
+
+bool Cgroup::read_stat(const char* file, const char* key,
+    uint64_t& value) const {
+    std::string content;
+    if (!read_control(m_path + "/" + file, content)) {
+        return false;
+    }
+    std::istringstream lines(content);
+    std::string name;
+    uint64_t number;
+    while (lines >> name >> number) {
+        if (name == key) {
+            value = number;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Cgroup::read_value(const char* file, uint64_t& value) const {
+    std::string content;
+    if (!read_control(m_path + "/" + file, content)) {
+        return false;
+    }
+    std::istringstream number(content);
+    return static_cast<bool>(number >> value);
+}
+
+bool Cgroup::read_io(uint64_t& read_bytes, uint64_t& write_bytes) const {
+    std::string content;
+    if (!read_control(m_path + "/io.stat", content)) {
+        return false;
+    }
+
+    // One line per device: "8:0 rbytes=1 wbytes=2 rios=3 ...".
+    read_bytes = 0;
+    write_bytes = 0;
+    std::istringstream words(content);
+    std::string word;
+    while (words >> word) {
+        if (word.compare(0, 7, "rbytes=") == 0) {
+            read_bytes += strtoull(word.c_str() + 7, NULL, 10);
+        } else if (word.compare(0, 7, "wbytes=") == 0) {
+            write_bytes += strtoull(word.c_str() + 7, NULL, 10);
+        }
+    }
+    return true;
+}
+
+int Cgroup::kill() const {
+    int error = write_control(m_path + "/cgroup.kill", "1");
+    if (error != ENOENT) {
+        return error;
+    }
+
+    // Older kernels: kill the members one by one. What they fork in
+    // the meantime is left to the next call.
+    std::string procs;
+    if (!read_control(m_path + "/cgroup.procs", procs)) {
+        return errno;
+    }
+    if (procs.empty()) {
+        return 0;
+    }
+    std::istringstream pids(procs);
+    pid_t pid;
+    while (pids >> pid) {
+        ::kill(pid, SIGKILL);
+    }
+    return EINPROGRESS;
+}
+
+} // namespace tuxlike
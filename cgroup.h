@@ -0,0 +1,131 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <cstdint>
+#include <string>
+
+namespace tuxlike {
+
+/**
+ * The cgroup v2 directory this process belongs to, found through
+ * /proc/self/cgroup and the cgroup2 entry of /proc/self/mounts.
+ *
+ * \return false if there is no cgroup v2 hierarchy.
+ */
+bool own_cgroup(std::string& path);
+
+/**
+ * A leaf cgroup v2 that holds the whole process tree of one job.
+ *
+ * The cgroup is removed in the destructor; it has to be empty by
+ * then, see `kill` and `populated`.
+ */
+class Cgroup {
+public:
+
+    Cgroup();
+    ~Cgroup();
+
+    Cgroup(const Cgroup&) = delete;
+    Cgroup& operator=(const Cgroup&) = delete;
+
+    /**
+     * Creates the directory `name` under the cgroup `parent`.
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int create(const std::string& parent, const std::string& name);
+
+    /**
+     * An open, close-on-exec `cgroup.procs`; the child writes "0"
+     * into it to move itself into the cgroup before it execs.
+     */
+    int procs_fd() const { return m_procs_fd; }
+
+    /**
+     * An open `cgroup.events`, which reports EPOLLPRI whenever the
+     * cgroup becomes empty or populated.
+     */
+    int events_fd() const { return m_events_fd; }
+
+    /// Whether any process is left in the cgroup.
+    bool populated() const;
+
+    /**
+     * Sends SIGKILL to every process of the cgroup at once through
+     * `cgroup.kill`, or one by one before Linux 5.14.
+     *
+     * \return 0 on success, EINPROGRESS if the processes were killed
+     *         one by one and should be killed again while the cgroup
+     *         stays populated, as they may have forked meanwhile, or
+     *         the `errno` describing the failure.
+     */
+    int kill() const;
+
+    /**
+     * Writes `value` into the control file `file`, such as
+     * `memory.max`.
+     *
+     * \return 0 on success, or the `errno` describing the failure;
+     *         ENOENT if the controller of the file is not enabled.
+     */
+    int set(const char* file, const std::string& value) const;
+
+    /**
+     * Reads `key` from a flat-keyed control file such as `cpu.stat`.
+     *
+     * \return false if the file or the key does not exist.
+     */
+    bool read_stat(const char* file, const char* key, uint64_t& value) const;
+
+    /**
+     * Reads a control file holding a single number, such as
+     * `memory.peak` (Linux 5.19).
+     *
+     * \return false if the file does not exist.
+     */
+    bool read_value(const char* file, uint64_t& value) const;
+
+    /**
+     * Sums the bytes read and written over all devices in `io.stat`.
+     *
+     * \return false if the file does not exist, which is the case
+     *         unless the io controller is enabled for the cgroup.
+     */
+    bool read_io(uint64_t& read_bytes, uint64_t& write_bytes) const;
+
+    const std::string& path() const { return m_path; }
+
+private:
+
+    std::string m_path;
+    int m_procs_fd;
+    int m_events_fd;
+};
+
+} // namespace tuxlike
+
+#endif // CGROUP_H
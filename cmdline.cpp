@@ -0,0 +1,360 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <algorithm>
+
+#include "cmdline.h"
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMDLINE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace tuxlike {
+
+template<typename Char>
+static bool needs_quoting(Char c) {
+    return c == Char(' ') || c == Char('\t') || c == Char('\n')
+        || c == Char('\v') || c == Char('"');
+}
+
+template<typename Char>
+static bool needs_escaping(Char c) {
+    return c == Char('\\') || c == Char('"');
+}
+
+#ifdef CMDLINE_SSE2
+
+/// Compares every character of the block with `c`.
+template<typename Char>
+static __m128i equal(__m128i block, Char c) {
+    if constexpr (sizeof(Char) == 1) {
+        return _mm_cmpeq_epi8(block, _mm_set1_epi8((char) c));
+    } else if constexpr (sizeof(Char) == 2) {
+        return _mm_cmpeq_epi16(block, _mm_set1_epi16((short) c));
+    } else {
+        return _mm_cmpeq_epi32(block, _mm_set1_epi32((int) c));
+    }
+}
+
+/**
+ * The index of the first character a `_mm_movemask_epi8` of
+ * per-character comparisons found; `mask` must not be 0.
+ */
+template<typename Char>
+static size_t first_lane(int mask) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, (unsigned long) mask);
+#else
+    unsigned bit = __builtin_ctz((unsigned) mask);
+#endif
+    return bit / sizeof(Char);
+}
+
+#endif // CMDLINE_SSE2
+
+template<typename Char>
+size_t find_quoting(const Char* text, size_t length) {
+    size_t i = 0;
+#ifdef CMDLINE_SSE2
+    const size_t lanes = 16 / sizeof(Char);
+    for (; i + lanes <= length; i += lanes) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(equal(block, Char(' ')), equal(block, Char('"'))),
+            _mm_or_si128(_mm_or_si128(equal(block, Char('\t')),
+                equal(block, Char('\n'))), equal(block, Char('\v'))));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return i + first_lane<Char>(mask);
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (needs_quoting(text[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+template<typename Char>
+size_t find_escaping(const Char* text, size_t length) {
+    size_t i = 0;
+#ifdef CMDLINE_SSE2
+    const size_t lanes = 16 / sizeof(Char);
+    for (; i + lanes <= length; i += lanes) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(
+            equal(block, Char('\\')), equal(block, Char('"'))));
+        if (mask != 0) {
+            return i + first_lane<Char>(mask);
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (needs_escaping(text[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+
+
+template<typename Char>
+static bool needs_quotes(std::basic_string_view<Char> argument, bool force) {
+    // Unless we're told otherwise, don't quote unless we actually
+    // need to do so --- hopefully avoid problems if programs won't
+    // parse quotes properly
+    return force || argument.empty()
+        || find_quoting(argument.data(), argument.size()) != argument.size();
+}
+
+template<typename Char>
+size_t quoted_length(std::basic_string_view<Char> argument, bool force) {
+    const Char* text = argument.data();
+    size_t length = argument.size();
+    if (!needs_quotes(argument, force)) {
+        return length;
+    }
+
+    // The quotes, plus a backslash for every quote and every backslash
+    // before a quote, see `write_quoted`.
+    size_t encoded = length + 2;
+    size_t i = 0;
+    for (;;) {
+        size_t special = i + find_escaping(text + i, length - i);
+        size_t end = special;
+        while (end < length && text[end] == Char('\\')) {
+            ++end;
+        }
+        if (end == length) {
+            encoded += end - special;
+            return encoded;
+        } else if (text[end] == Char('"')) {
+            encoded += end - special + 1;
+            i = end + 1;
+        } else {
+            i = end;
+        }
+    }
+}
+
+/**
+ * Writes the argument as `quote_argument` encodes it.
+ *
+ * \param[in] quoted whether it `needs_quotes`.
+ * \param[out] out has room for the `quoted_length` of the argument.
+ * \return the end of what was written.
+ */
+template<typename Char>
+static Char* write_quoted(std::basic_string_view<Char> argument,
+    bool quoted, Char* out)
+{
+    const Char* text = argument.data();
+    size_t length = argument.size();
+    if (!quoted) {
+        return std::copy(text, text + length, out);
+    }
+
+    *out++ = Char('"');
+    size_t i = 0;
+    for (;;) {
+        // Everything up to a backslash or quote is copied as it is.
+        size_t special = i + find_escaping(text + i, length - i);
+        out = std::copy(text + i, text + special, out);
+
+        size_t end = special;
+        while (end < length && text[end] == Char('\\')) {
+            ++end;
+        }
+        size_t backslashes = end - special;
+
+        if (end == length) {
+            // Escape all backslashes, but let the terminating
+            // double quotation mark we add below be interpreted
+            // as a metacharacter.
+            out = std::fill_n(out, backslashes * 2, Char('\\'));
+            break;
+        } else if (text[end] == Char('"')) {
+            // Escape all backslashes and the following
+            // double quotation mark.
+            out = std::fill_n(out, backslashes * 2 + 1, Char('\\'));
+            *out++ = Char('"');
+            i = end + 1;
+        } else {
+            // Backslashes aren't special here.
+            out = std::fill_n(out, backslashes, Char('\\'));
+            i = end;
+        }
+    }
+    *out++ = Char('"');
+    return out;
+}
+
+template<typename Char>
+void quote_argument(std::basic_string_view<Char> argument,
+    std::basic_string<Char>& command_line, bool force)
+{
+    size_t length = quoted_length(argument, force);
+    size_t start = command_line.size();
+    command_line.resize(start + length);
+    write_quoted(argument, length != argument.size(), &command_line[start]);
+}
+
+template<typename Char>
+void encode_command_line(std::span<const Char* const> arguments,
+    std::basic_string<Char>& command_line, bool force)
+{
+    size_t length = arguments.empty() ? 0 : arguments.size() - 1;
+    for (const Char* argument : arguments) {
+        length += quoted_length(std::basic_string_view<Char>(argument), force);
+    }
+
+    command_line.resize(length);
+    Char* out = command_line.data();
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (i > 0) {
+            *out++ = Char(' ');
+        }
+        std::basic_string_view<Char> argument(arguments[i]);
+        out = write_quoted(argument, needs_quotes(argument, force), out);
+    }
+}
+
+template<typename Char>
+std::basic_string<Char> encode_command_line(
+    std::span<const Char* const> arguments, bool force)
+{
+    std::basic_string<Char> command_line;
+    encode_command_line(arguments, command_line, force);
+    return command_line;
+}
+
+
+
+template<typename Char>
+static bool is_blank(Char c) {
+    return c == Char(' ') || c == Char('\t');
+}
+
+template<typename Char>
+std::vector<std::basic_string<Char>> decode_command_line(
+    std::basic_string_view<Char> command_line)
+{
+    std::vector<std::basic_string<Char>> arguments;
+    const Char* s = command_line.data();
+    const Char* end = s + command_line.size();
+    if (s == end) {
+        return arguments;
+    }
+
+    // The program is taken as it is.
+    if (*s == Char('"')) {
+        const Char* quote = std::find(s + 1, end, Char('"'));
+        arguments.emplace_back(s + 1, quote);
+        s = quote == end ? end : quote + 1;
+    } else {
+        const Char* blank = std::find_if(s, end, is_blank<Char>);
+        arguments.emplace_back(s, blank);
+        s = blank;
+    }
+
+    for (;;) {
+        while (s != end && is_blank(*s)) {
+            s++;
+        }
+        if (s == end) {
+            return arguments;
+        }
+
+        // Within quotes while `quotes` is 1. A quote that closes them
+        // makes it 2 and, as CommandLineToArgvW has it, a quote right
+        // after that is literal and leaves them closed.
+        std::basic_string<Char> argument;
+        int quotes = 0;
+        size_t backslashes = 0;
+        while (s != end && (quotes != 0 || !is_blank(*s))) {
+            if (*s == Char('\\')) {
+                argument.push_back(*s++);
+                backslashes++;
+                continue;
+            }
+            if (*s != Char('"')) {
+                argument.push_back(*s++);
+                backslashes = 0;
+                continue;
+            }
+
+            // Of 2n backslashes before a quote, n are left and the
+            // quote opens or closes; of 2n+1, n are left and the quote
+            // is literal.
+            argument.resize(argument.size() - (backslashes + 1) / 2);
+            if (backslashes % 2 == 0) {
+                quotes++;
+            } else {
+                argument.push_back(Char('"'));
+            }
+            backslashes = 0;
+            for (s++; s != end && *s == Char('"'); s++) {
+                if (++quotes == 3) {
+                    argument.push_back(Char('"'));
+                    quotes = 0;
+                }
+            }
+            if (quotes == 2) {
+                quotes = 0;
+            }
+        }
+        arguments.push_back(std::move(argument));
+    }
+}
+
+
+
+#define INSTANTIATE_CMDLINE(Char) \
+    template size_t find_quoting(const Char*, size_t); \
+    template size_t find_escaping(const Char*, size_t); \
+    template size_t quoted_length(std::basic_string_view<Char>, bool); \
+    template void quote_argument(std::basic_string_view<Char>, \
+        std::basic_string<Char>&, bool); \
+    template void encode_command_line(std::span<const Char* const>, \
+        std::basic_string<Char>&, bool); \
+    template std::basic_string<Char> encode_command_line( \
+        std::span<const Char* const>, bool); \
+    template std::vector<std::basic_string<Char>> decode_command_line( \
+        std::basic_string_view<Char>);
+
+INSTANTIATE_CMDLINE(char)
+INSTANTIATE_CMDLINE(char16_t)
+INSTANTIATE_CMDLINE(wchar_t)
+
+} // namespace tuxlike
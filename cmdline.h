@@ -0,0 +1,132 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tuxlike {
+
+/*
+ * The command lines of Windows, for any character type: `char`,
+ * `char16_t` or `wchar_t`. Nothing here depends on Windows, so
+ * command lines for it can be built and checked anywhere.
+ */
+
+/**
+ * Finds the first character that makes an argument need quotes:
+ * a space, `\t`, `\n`, `\v` or `"`.
+ *
+ * \return its index, or `length` if there is none.
+ */
+template<typename Char>
+size_t find_quoting(const Char* text, size_t length);
+
+/**
+ * Finds the first character that may need escaping within quotes:
+ * a backslash or `"`.
+ *
+ * \return its index, or `length` if there is none.
+ */
+template<typename Char>
+size_t find_escaping(const Char* text, size_t length);
+
+/**
+ * The exact length of the argument once `quote_argument` encoded it.
+ */
+template<typename Char>
+size_t quoted_length(std::basic_string_view<Char> argument, bool force);
+
+/**
+ * This routine appends the given argument to a command line such
+ * that CommandLineToArgvW will return the argument string unchanged.
+ * Arguments in a command line should be separated by spaces;
+ * this function does not add these spaces.
+ *
+ * Source:
+ * https://blogs.msdn.microsoft.com/twistylittlepassagesallalike/2011/04/23/everyone-quotes-command-line-arguments-the-wrong-way/
+ *
+ * The argument is scanned and copied a vector of characters at a
+ * time where SSE2 is available, see `find_quoting` and `find_escaping`.
+ *
+ * \param[in] argument supplies the argument to encode.
+ * \param[out] command_line supplies the command line to which
+ *             we append the encoded argument string.
+ * \param[in] force supplies an indication of whether we should quote
+ *            the argument even if it does not contain any characters
+ *            that would ordinarily require quoting.
+ */
+template<typename Char>
+void quote_argument(std::basic_string_view<Char> argument,
+    std::basic_string<Char>& command_line, bool force);
+
+/**
+ * Encodes the arguments into a command line, separated by spaces,
+ * for CreateProcessW to pass on to the program.
+ *
+ * The length of the command line is computed first, so it is
+ * allocated at most once and, if `command_line` already has the
+ * capacity, not at all. No argument is copied on the way.
+ *
+ * \param[in] arguments the arguments, including the program.
+ * \param[out] command_line replaced by the command line.
+ * \param[in] force quote every argument, see `quote_argument`.
+ */
+template<typename Char>
+void encode_command_line(std::span<const Char* const> arguments,
+    std::basic_string<Char>& command_line, bool force = false);
+
+/**
+ * \return the command line of the arguments, see above.
+ */
+template<typename Char>
+std::basic_string<Char> encode_command_line(
+    std::span<const Char* const> arguments, bool force = false);
+
+/**
+ * Splits a command line into its arguments as CommandLineToArgvW
+ * does, see `encode_command_line` for the opposite.
+ *
+ * The first argument is the program, which ends at the first space
+ * or tab or, if it starts with a quote, at the next quote; it has
+ * no escapes. Unlike CommandLineToArgvW, an empty command line has
+ * no arguments rather than the path of the running program.
+ *
+ * Every argument that `quote_argument` encodes comes back unchanged,
+ * and so does the program, unless it contains a quote, or needs
+ * quotes and ends with a backslash; the path of a file does neither.
+ *
+ * \return the arguments, including the program.
+ */
+template<typename Char>
+std::vector<std::basic_string<Char>> decode_command_line(
+    std::basic_string_view<Char> command_line);
+
+} // namespace tuxlike
+
+#endif // CMDLINE_H
@@ -0,0 +1,272 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Tests of cmdline.h, run by ctest as `cmdline_test TEST`.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cmdline.h"
+
+using namespace tuxlike;
+
+/// Random arguments checked per character type.
+#define QUOTE_ARGUMENTS 200000
+
+/// Random command lines encoded and decoded per character type.
+#define ROUND_TRIPS 100000
+
+/**
+ * The per-character ArgvQuote the SIMD scans replaced, as the
+ * reference for `quote_argument`.
+ */
+template<typename Char>
+static void reference_quote(const std::basic_string<Char>& argument,
+    std::basic_string<Char>& command_line, bool force)
+{
+    static const Char QUOTING[] = {
+        Char(' '), Char('\t'), Char('\n'), Char('\v'), Char('"'), Char(0)
+    };
+    if (force == false && argument.empty() == false
+            && argument.find_first_of(QUOTING) == argument.npos) {
+        command_line.append(argument);
+        return;
+    }
+
+    command_line.push_back(Char('"'));
+    for (auto it = argument.begin(); ; ++it) {
+        size_t backslashes = 0;
+        while (it != argument.end() && *it == Char('\\')) {
+            ++it;
+            ++backslashes;
+        }
+        if (it == argument.end()) {
+            command_line.append(backslashes * 2, Char('\\'));
+            break;
+        } else if (*it == Char('"')) {
+            command_line.append(backslashes * 2 + 1, Char('\\'));
+            command_line.push_back(*it);
+        } else {
+            command_line.append(backslashes, Char('\\'));
+            command_line.push_back(*it);
+        }
+    }
+    command_line.push_back(Char('"'));
+}
+
+/**
+ * A random argument, never containing NUL. Most of its characters are
+ * plain, the special ones come in runs and alone at any position, so
+ * they land on either side of the block boundaries of the scans.
+ */
+template<typename Char>
+static std::basic_string<Char> random_argument(std::mt19937& random,
+    size_t length)
+{
+    static const char SPECIAL[] = " \t\n\v\"\\";
+    std::basic_string<Char> argument(length, Char('a'));
+    unsigned density = random() % 8;
+    for (Char& c : argument) {
+        unsigned dice = random() % 64;
+        if (dice < density) {
+            c = Char(SPECIAL[random() % (sizeof(SPECIAL) - 1)]);
+        } else if (dice < density + 4) {
+            // Beyond ASCII: the bytes of a special character in a
+            // wider lane must not match it.
+            c = Char(sizeof(Char) == 1 ? 0x80 + random() % 0x80
+                : (SPECIAL[random() % (sizeof(SPECIAL) - 1)]
+                    | (1 + random() % 0xff) << 8));
+        }
+    }
+    return argument;
+}
+
+/**
+ * Lengths around every multiple of the SSE2 block of `Char`, up to
+ * four blocks, and beyond them at random.
+ */
+template<typename Char>
+static size_t random_length(std::mt19937& random) {
+    const size_t lanes = 16 / sizeof(Char);
+    if (random() % 4 == 0) {
+        return random() % 200;
+    }
+    size_t length = lanes * (random() % 5);
+    int offset = (int) (random() % 3) - 1;
+    return offset < 0 && length == 0 ? 0 : length + offset;
+}
+
+/**
+ * Compares `quote_argument` and `encode_command_line` with the
+ * per-character reference on random arguments.
+ */
+template<typename Char>
+static bool test_quote(const char* type) {
+    std::mt19937 random(1);
+    for (int i = 0; i < QUOTE_ARGUMENTS; i++) {
+        std::basic_string<Char> argument =
+            random_argument<Char>(random, random_length<Char>(random));
+        bool force = random() % 4 == 0;
+
+        // A special character right at the end of a block.
+        if (!argument.empty() && random() % 4 == 0) {
+            argument.back() = Char(random() % 2 ? '"' : '\\');
+        }
+
+        std::basic_string<Char> expected, quoted;
+        reference_quote(argument, expected, force);
+        quote_argument(std::basic_string_view<Char>(argument), quoted, force);
+        if (quoted != expected) {
+            printf("quote_argument<%s> differs for argument %d.\n", type, i);
+            return false;
+        }
+        if (quoted_length(std::basic_string_view<Char>(argument), force)
+                != expected.size()) {
+            printf("quoted_length<%s> differs for argument %d.\n", type, i);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < QUOTE_ARGUMENTS / 10; i++) {
+        std::vector<std::basic_string<Char>> arguments(random() % 6);
+        std::vector<const Char*> pointers;
+        std::basic_string<Char> expected;
+        bool force = random() % 4 == 0;
+        for (auto& argument : arguments) {
+            argument = random_argument<Char>(random,
+                random_length<Char>(random));
+            pointers.push_back(argument.c_str());
+            if (&argument != &arguments[0]) {
+                expected.push_back(Char(' '));
+            }
+            reference_quote(argument, expected, force);
+        }
+
+        std::basic_string<Char> command_line = encode_command_line(
+            std::span<const Char* const>(pointers), force);
+        if (command_line != expected) {
+            printf("encode_command_line<%s> differs for command line %d.\n",
+                type, i);
+            return false;
+        }
+    }
+    printf("%s: %d arguments as quoted before.\n", type, QUOTE_ARGUMENTS);
+    return true;
+}
+
+/**
+ * Whether the arguments decode to themselves once encoded.
+ */
+template<typename Char>
+static bool round_trips(const std::vector<std::basic_string<Char>>& arguments,
+    bool force)
+{
+    std::vector<const Char*> pointers;
+    for (const auto& argument : arguments) {
+        pointers.push_back(argument.c_str());
+    }
+    std::basic_string<Char> command_line = encode_command_line(
+        std::span<const Char* const>(pointers), force);
+    return decode_command_line(std::basic_string_view<Char>(command_line))
+        == arguments;
+}
+
+template<typename Char>
+static std::basic_string<Char> widen(const char* text) {
+    std::string narrow(text);
+    return std::basic_string<Char>(narrow.begin(), narrow.end());
+}
+
+/**
+ * Encodes and decodes random command lines, heavy on the characters
+ * that need quoting or escaping, and checks the programs that
+ * `decode_command_line` documents not to come back.
+ */
+template<typename Char>
+static bool test_round_trip(const char* type) {
+    // None contains a quote; the last one ends with a backslash and
+    // is only used where it stays unquoted.
+    static const char* const PROGRAMS[] = {
+        "tool.exe", "C:\\Program Files\\tool.exe", "C:\\bin\\tool.exe", "",
+        "with\ttab", "C:\\",
+    };
+
+    std::mt19937 random(2);
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        std::vector<std::basic_string<Char>> arguments;
+        bool force = random() % 4 == 0;
+        arguments.push_back(widen<Char>(PROGRAMS[random() % (force ? 5 : 6)]));
+        for (unsigned n = random() % 8; n > 0; n--) {
+            arguments.push_back(random_argument<Char>(random,
+                random_length<Char>(random)));
+        }
+        if (!round_trips(arguments, force)) {
+            printf("%s: command line %d does not round-trip.\n", type, i);
+            return false;
+        }
+    }
+
+    // The program has no escapes, so these cannot come back.
+    static const char* const EXCEPTIONS[] = {
+        "say\"hello\".exe", "C:\\with space\\", "C:\\",
+    };
+    for (const char* program : EXCEPTIONS) {
+        std::vector<std::basic_string<Char>> arguments = {
+            widen<Char>(program), widen<Char>("argument"),
+        };
+        if (round_trips(arguments, true)) {
+            printf("%s: program '%s' round-trips, unlike documented.\n",
+                type, program);
+            return false;
+        }
+    }
+    printf("%s: %d command lines round-trip.\n", type, ROUND_TRIPS);
+    return true;
+}
+
+
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s quote|round_trip\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool ok;
+    if (strcmp(argv[1], "quote") == 0) {
+        ok = test_quote<char>("char") && test_quote<char16_t>("char16_t")
+            && test_quote<wchar_t>("wchar_t");
+    } else if (strcmp(argv[1], "round_trip") == 0) {
+        ok = test_round_trip<char>("char")
+            && test_round_trip<char16_t>("char16_t")
+            && test_round_trip<wchar_t>("wchar_t");
+    } else {
+        fprintf(stderr, "Unknown test '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
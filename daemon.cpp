@@ -0,0 +1,461 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "event_loop.h"
+#include "linux_sys.h"
+#include "tuxliketimeout.h"
+
+namespace tuxlike {
+
+/**
+ * Fills the address of the socket at `path`.
+ *
+ * \return false if the path does not fit.
+ */
+static bool socket_address(const std::string& path, struct sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/**
+ * Receives one whole message, whatever its size.
+ *
+ * \return 0 on success, or the `errno` describing the failure.
+ *         An empty message means that the peer hung up.
+ */
+static int receive_message(int fd, std::string& message) {
+    for (;;) {
+        // Peek at the size first; a truncated message would be lost.
+        char probe;
+        ssize_t size = recv(fd, &probe, 1, MSG_PEEK | MSG_TRUNC);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        message.resize(size);
+        if (size == 0) {
+            // Either the peer hung up, or it sent an empty message.
+            recv(fd, &probe, 1, 0);
+            return 0;
+        }
+        ssize_t got = recv(fd, &message[0], size, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        message.resize(got);
+        return 0;
+    }
+}
+
+/**
+ * Splits a message into its NUL-terminated fields.
+ *
+ * \return false if the last field is not terminated.
+ */
+static bool split_fields(const std::string& message,
+    std::vector<std::string>& fields) {
+
+    size_t pos = 0;
+    while (pos < message.size()) {
+        size_t end = message.find('\0', pos);
+        if (end == message.npos) {
+            return false;
+        }
+        fields.emplace_back(message, pos, end - pos);
+        pos = end + 1;
+    }
+    return true;
+}
+
+static void append_field(std::string& message, const std::string& field) {
+    message += field;
+    message += '\0';
+}
+
+/**
+ * Decodes a request, see `run_daemon`.
+ *
+ * \return false if the request is malformed.
+ */
+static bool decode_request(const std::string& message, std::string& tag,
+    Job& job) {
+
+    std::vector<std::string> fields;
+    if (!split_fields(message, fields) || fields.size() < 5) {
+        return false;
+    }
+    tag = fields[0];
+    if (!parse_duration(fields[1], job.m_timeout_ns)) {
+        return false;
+    }
+    job.m_cwd = fields[2];
+
+    char* end;
+    errno = 0;
+    unsigned long argc = strtoul(fields[3].c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || argc == 0
+            || argc > fields.size() - 4) {
+        return false;
+    }
+    job.m_argv.assign(fields.begin() + 4, fields.begin() + 4 + argc);
+    job.m_replace_env = true;
+    job.m_env.assign(fields.begin() + 4 + argc, fields.end());
+    return true;
+}
+
+
+
+/**
+ * A client of the daemon; closed once neither we nor a job need it.
+ */
+struct Connection {
+
+    explicit Connection(int fd) : m_fd(fd), m_watched(false) {}
+    ~Connection() { close(m_fd); }
+
+    int m_fd;
+
+    /// Whether the event loop watches the connection, that is, until
+    /// the client hangs up.
+    bool m_watched;
+
+    /// Replies the socket had no room for yet.
+    std::deque<std::string> m_replies;
+};
+
+/**
+ * Sends the queued replies, as far as the socket takes them, and
+ * watches for room for the rest.
+ */
+static void flush(EventLoop& loop, Connection& connection) {
+    while (!connection.m_replies.empty()) {
+        const std::string& reply = connection.m_replies.front();
+        if (send(connection.m_fd, reply.data(), reply.size(),
+                MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            // The client is gone, and so are its replies.
+            connection.m_replies.clear();
+            break;
+        }
+        connection.m_replies.pop_front();
+    }
+    if (connection.m_watched) {
+        loop.modify(connection.m_fd, connection.m_replies.empty()
+            ? EPOLLIN : EPOLLIN | EPOLLOUT);
+    }
+}
+
+static void reply(EventLoop& loop, Connection& connection,
+    const std::string& tag, int exit_code) {
+
+    std::string message;
+    append_field(message, tag);
+    append_field(message, std::to_string(exit_code));
+    connection.m_replies.push_back(std::move(message));
+    if (connection.m_replies.size() == 1) {
+        flush(loop, connection);
+    }
+}
+
+/// Written to by the handler of SIGINT and SIGTERM.
+static int g_stop_pipe = -1;
+
+static void request_stop(int) {
+    int saved = errno;
+    ssize_t ignored = write(g_stop_pipe, "", 1);
+    (void) ignored;
+    errno = saved;
+}
+
+/**
+ * Binds the listening socket, taking over a stale socket file left
+ * behind by a daemon that is gone, but not one that is alive. Only
+ * our own user may connect; see also `same_user`.
+ *
+ * \return the socket, or -1 after reporting the problem.
+ */
+static int listen_at(const std::string& path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, address)) {
+        std::cerr << "The socket path '" << path << "' is too long.";
+        std::cerr << std::endl;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        std::cerr << "socket failed. (" << strerror(errno) << ")" << std::endl;
+        return -1;
+    }
+
+    int result = bind(fd, (struct sockaddr*) &address, sizeof(address));
+    if (result < 0 && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr*) &address,
+                sizeof(address)) < 0 && errno == ECONNREFUSED) {
+            unlink(path.c_str());
+            result = bind(fd, (struct sockaddr*) &address, sizeof(address));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe >= 0) {
+            close(probe);
+        }
+    }
+    // Nobody can connect before listen, so there is no window.
+    if (result == 0) {
+        result = chmod(path.c_str(), S_IRUSR | S_IWUSR);
+    }
+    if (result < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen at '" << path << "'. (";
+        std::cerr << strerror(errno) << ")" << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Whether the peer of the connection runs as our effective user; the
+ * jobs run as that user, so nobody else may submit any.
+ */
+static bool same_user(int fd) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0
+        && credentials.uid == geteuid();
+}
+
+int run_daemon(const std::string& path, const SupervisorOptions& options) {
+
+    int stop_pipe[2];
+    if (pipe2(stop_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        std::cerr << "pipe2 failed. (" << strerror(errno) << ")" << std::endl;
+        return EXIT_CANCELED;
+    }
+    FdGuard stop_read(stop_pipe[0]);
+    FdGuard stop_write(stop_pipe[1]);
+
+    int listen_fd = listen_at(path);
+    if (listen_fd < 0) {
+        return EXIT_CANCELED;
+    }
+
+    // Replies go to the connection that submitted the job.
+    struct Pending {
+        std::shared_ptr<Connection> m_connection;
+        std::string m_tag;
+    };
+    std::unordered_map<size_t, Pending> pending;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+    Supervisor supervisor(options, [&](size_t job, const JobResult& result) {
+        auto it = pending.find(job);
+        if (it != pending.end()) {
+            reply(supervisor.loop(), *it->second.m_connection,
+                it->second.m_tag, result.m_exit_code);
+            pending.erase(it);
+        }
+    });
+    if (!supervisor.open()) {
+        close(listen_fd);
+        unlink(path.c_str());
+        return EXIT_CANCELED;
+    }
+    EventLoop& loop = supervisor.loop();
+
+    auto serve = [&](int fd, uint32_t events) {
+        std::shared_ptr<Connection> connection = connections[fd];
+        if (events & EPOLLOUT) {
+            flush(loop, *connection);
+        }
+        if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            return;
+        }
+
+        std::string message;
+        int error = receive_message(fd, message);
+        if (error == EAGAIN) {
+            return;
+        }
+        if (error != 0 || message.empty()) {
+            loop.remove(fd);
+            connection->m_watched = false;
+            connections.erase(fd);
+            return;
+        }
+
+        std::string tag;
+        Job job;
+        if (!decode_request(message, tag, job)) {
+            std::cerr << "Malformed request." << std::endl;
+            reply(loop, *connection, tag, EXIT_CANCELED);
+            return;
+        }
+        size_t index = supervisor.submit(std::move(job));
+        pending[index] = Pending{ connection, tag };
+    };
+
+    int error = loop.add(listen_fd, EPOLLIN, [&](uint32_t) {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL,
+                SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+            if (!same_user(fd)) {
+                std::cerr << "Refused a connection of another user.";
+                std::cerr << std::endl;
+                close(fd);
+                continue;
+            }
+            std::shared_ptr<Connection> connection
+                = std::make_shared<Connection>(fd);
+            int error = loop.add(fd, EPOLLIN, [&serve, fd](uint32_t events) {
+                serve(fd, events);
+            });
+            if (error == 0) {
+                connection->m_watched = true;
+                connections[fd] = connection;
+            }
+        }
+    });
+
+    bool stopping = false;
+    if (error == 0) {
+        error = loop.add(stop_read.m_fd, EPOLLIN, [&](uint32_t) {
+            stopping = true;
+            loop.remove(stop_read.m_fd);
+            loop.remove(listen_fd);
+            close(listen_fd);
+            listen_fd = -1;
+            unlink(path.c_str());
+        });
+    }
+    if (error != 0) {
+        std::cerr << "epoll_ctl failed. (" << strerror(error) << ")";
+        std::cerr << std::endl;
+        close(listen_fd);
+        unlink(path.c_str());
+        return EXIT_CANCELED;
+    }
+
+    g_stop_pipe = stop_write.m_fd;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int status = 0;
+    while (!stopping || supervisor.pending() > 0) {
+        if (supervisor.run_once() != 0) {
+            status = EXIT_CANCELED;
+        }
+    }
+
+    // The handlers refer to our locals.
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    g_stop_pipe = -1;
+    for (auto& connection : connections) {
+        loop.remove(connection.first);
+    }
+    return status;
+}
+
+
+
+int submit_job(const std::string& path, const Job& job) {
+    struct sockaddr_un address;
+    if (!socket_address(path, address)) {
+        std::cerr << "The socket path '" << path << "' is too long.";
+        std::cerr << std::endl;
+        return EXIT_CANCELED;
+    }
+
+    FdGuard fd(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (fd.m_fd < 0 || connect(fd.m_fd, (struct sockaddr*) &address,
+            sizeof(address)) < 0) {
+        std::cerr << "Cannot connect to '" << path << "'. (";
+        std::cerr << strerror(errno) << ")" << std::endl;
+        return EXIT_CANCELED;
+    }
+
+    std::string request;
+    append_field(request, "1");
+    append_field(request, job.m_timeout_ns == DURATION_INFINITE
+        ? std::string("4294967295") : std::to_string(job.m_timeout_ns) + "ns");
+    append_field(request, job.m_cwd);
+    append_field(request, std::to_string(job.m_argv.size()));
+    for (const std::string& arg : job.m_argv) {
+        append_field(request, arg);
+    }
+    for (const std::string& variable : job.m_env) {
+        append_field(request, variable);
+    }
+    if (send(fd.m_fd, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+        std::cerr << "Cannot submit the job. (" << strerror(errno) << ")";
+        std::cerr << std::endl;
+        return EXIT_CANCELED;
+    }
+
+    std::string reply;
+    int error = receive_message(fd.m_fd, reply);
+    std::vector<std::string> fields;
+    if (error != 0 || !split_fields(reply, fields) || fields.size() != 2) {
+        std::cerr << "The daemon did not report the job." << std::endl;
+        return EXIT_CANCELED;
+    }
+    return atoi(fields[1].c_str());
+}
+
+} // namespace tuxlike
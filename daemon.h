@@ -0,0 +1,68 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+
+#include "job.h"
+#include "supervisor.h"
+
+namespace tuxlike {
+
+/**
+ * Serves jobs submitted through a `SOCK_SEQPACKET` Unix socket at
+ * `path`, until SIGINT or SIGTERM; then stops accepting jobs and
+ * returns once the running ones are done.
+ *
+ * Every message is a sequence of NUL-terminated fields. A request is
+ *
+ *     TAG TIMEOUT CWD ARGC ARGV... ENV...
+ *
+ * where TIMEOUT is a duration as accepted by `parse_duration`, an
+ * empty CWD keeps our working directory and the remaining fields are
+ * the whole environment of the job. Once the job is done, the reply
+ *
+ *     TAG STATUS
+ *
+ * carries its exit code, as `run_job` would return it. A client may
+ * have any number of jobs running, the TAG tells the replies apart.
+ *
+ * Problems are reported on stderr.
+ *
+ * \return the exit code for the daemon itself.
+ */
+int run_daemon(const std::string& path, const SupervisorOptions& options);
+
+/**
+ * Runs the job in the daemon listening at `path` and waits for it.
+ *
+ * \return the exit code of the job, or `EXIT_CANCELED` if the daemon
+ *         could not be reached.
+ */
+int submit_job(const std::string& path, const Job& job);
+
+} // namespace tuxlike
+
+#endif // DAEMON_H
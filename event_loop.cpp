@@ -0,0 +1,317 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "event_loop.h"
+#include "uring.h"
+
+namespace tuxlike {
+
+/// Operations the ring queues between two rounds before it submits.
+#define RING_ENTRIES 256
+
+bool parse_event_engine(const char* name, EventEngine& engine) {
+    if (strcmp(name, "auto") == 0) {
+        engine = EventEngine::Auto;
+    } else if (strcmp(name, "epoll") == 0) {
+        engine = EventEngine::Epoll;
+    } else if (strcmp(name, "io_uring") == 0) {
+        engine = EventEngine::IoUring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* event_engine_name(EventEngine engine) {
+    switch (engine) {
+        case EventEngine::Auto:    return "auto";
+        case EventEngine::Epoll:   return "epoll";
+        case EventEngine::IoUring: return "io_uring";
+    }
+    return "?";
+}
+
+
+
+static uint64_t user_data(const void* watch) {
+    return reinterpret_cast<uintptr_t>(watch);
+}
+
+EventLoop::EventLoop(EventEngine engine)
+    : m_engine(EventEngine::Epoll), m_error(0), m_epoll_fd(-1),
+      m_timer_fd(-1), m_timer_fd_deadline(NO_DEADLINE) {
+    if (engine != EventEngine::Epoll) {
+        m_ring.reset(new IoUring);
+        m_error = m_ring->open(RING_ENTRIES);
+        if (m_error == 0) {
+            m_engine = EventEngine::IoUring;
+            return;
+        }
+        m_ring.reset();
+        if (engine == EventEngine::IoUring) {
+            return;
+        }
+    }
+    m_error = open_epoll();
+}
+
+int EventLoop::open_epoll() {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        return errno;
+    }
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (m_timer_fd < 0) {
+        return errno;
+    }
+    return add(m_timer_fd, EPOLLIN, [this](uint32_t) {
+        uint64_t expirations;
+        ssize_t ignored = read(m_timer_fd, &expirations,
+            sizeof(expirations));
+        (void) ignored;
+        m_timer_fd_deadline = NO_DEADLINE;
+    });
+}
+
+EventLoop::~EventLoop() {
+    if (m_timer_fd >= 0) {
+        close(m_timer_fd);
+    }
+    if (m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+    }
+}
+
+uint64_t EventLoop::now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void EventLoop::arm(Timer& timer, uint64_t deadline) {
+    m_wheel.arm(timer, deadline);
+}
+
+void EventLoop::cancel(Timer& timer) {
+    m_wheel.cancel(timer);
+}
+
+void EventLoop::expire_timers() {
+    uint64_t now = EventLoop::now();
+    Timer* timer;
+    while ((timer = m_wheel.pop_expired(now)) != nullptr) {
+        timer->m_callback();
+    }
+}
+
+void EventLoop::post(std::function<void()> callback) {
+    m_posted.push_back(std::move(callback));
+}
+
+void EventLoop::run_posted() {
+    // Callbacks posted from here on wait for the next round.
+    std::vector<std::function<void()>> posted;
+    posted.swap(m_posted);
+    for (auto& callback : posted) {
+        callback();
+    }
+}
+
+int EventLoop::add(int fd, uint32_t events, Handler handler) {
+    if (m_error != 0) {
+        return m_error;
+    }
+
+    std::unique_ptr<Watch> watch(
+        new Watch{ fd, events, std::move(handler), false });
+    if (m_ring) {
+        int error = m_ring->poll_add(fd, events, user_data(watch.get()));
+        if (error != 0) {
+            return error;
+        }
+        watch->m_polled = true;
+        m_watches[fd] = std::move(watch);
+        return 0;
+    }
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = watch.get();
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return errno;
+    }
+    m_watches[fd] = std::move(watch);
+    return 0;
+}
+
+int EventLoop::modify(int fd, uint32_t events) {
+    auto it = m_watches.find(fd);
+    if (it == m_watches.end()) {
+        return ENOENT;
+    }
+    Watch* watch = it->second.get();
+    watch->m_events = events;
+    if (m_ring) {
+        // An unpolled watch is in its handler and gets re-armed with
+        // the new events once it returns.
+        return watch->m_polled
+            ? m_ring->poll_update(user_data(watch), events) : 0;
+    }
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = it->second.get();
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+void EventLoop::remove(int fd) {
+    auto it = m_watches.find(fd);
+    if (it == m_watches.end()) {
+        return;
+    }
+    Watch* watch = it->second.get();
+    watch->m_fd = -1;
+    if (m_ring) {
+        // The completion of the poll still points to the watch.
+        if (watch->m_polled) {
+            m_ring->poll_remove(user_data(watch));
+            m_retired[watch] = std::move(it->second);
+        } else {
+            m_removed.push_back(std::move(it->second));
+        }
+    } else {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        m_removed.push_back(std::move(it->second));
+    }
+    m_watches.erase(it);
+}
+
+int EventLoop::run_once(int timeout_ms) {
+    if (m_error != 0) {
+        return m_error;
+    }
+    if (!m_posted.empty()) {
+        timeout_ms = 0;
+    }
+
+    int error = m_ring ? wait_ring(timeout_ms) : wait_epoll(timeout_ms);
+    if (error != 0) {
+        return error;
+    }
+
+    expire_timers();
+    run_posted();
+    return 0;
+}
+
+int EventLoop::wait_epoll(int timeout_ms) {
+    // Arm the timerfd for the next deadline, unless it already is.
+    uint64_t wakeup = m_wheel.next_wakeup(now());
+    if (wakeup != m_timer_fd_deadline) {
+        struct itimerspec spec = {};
+        if (wakeup != NO_DEADLINE) {
+            // A zero it_value would disarm the timer.
+            uint64_t when = wakeup == 0 ? 1 : wakeup;
+            spec.it_value.tv_sec = when / 1000000000ULL;
+            spec.it_value.tv_nsec = when % 1000000000ULL;
+        }
+        if (timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+            return errno;
+        }
+        m_timer_fd_deadline = wakeup;
+    }
+
+    struct epoll_event events[64];
+    int ready = epoll_wait(m_epoll_fd, events, 64, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : errno;
+    }
+
+    for (int i = 0; i < ready; i++) {
+        Watch* watch = static_cast<Watch*>(events[i].data.ptr);
+        if (watch->m_fd >= 0) {
+            watch->m_handler(events[i].events);
+        }
+    }
+    m_removed.clear();
+    return 0;
+}
+
+int EventLoop::wait_ring(int timeout_ms) {
+    uint64_t now = EventLoop::now();
+    uint64_t timeout_ns = timeout_ms < 0
+        ? UINT64_MAX : static_cast<uint64_t>(timeout_ms) * 1000000ULL;
+    uint64_t wakeup = m_wheel.next_wakeup(now);
+    if (wakeup != NO_DEADLINE) {
+        timeout_ns = std::min(timeout_ns, wakeup > now ? wakeup - now : 0);
+    }
+
+    int error = m_ring->enter(timeout_ns);
+    if (error != 0) {
+        return error;
+    }
+
+    // Only what is ready now; polls re-armed by this round complete
+    // in the next one.
+    struct io_uring_cqe cqe;
+    for (unsigned ready = m_ring->ready_count(); ready > 0; ready--) {
+        m_ring->pop(cqe);
+        if (cqe.user_data == IoUring::IGNORED) {
+            continue;
+        }
+        Watch* watch = reinterpret_cast<Watch*>(cqe.user_data);
+        watch->m_polled = false;
+        if (watch->m_fd < 0) {
+            m_retired.erase(watch);
+            continue;
+        }
+
+        // A poll fails if the descriptor does, report it as epoll would.
+        watch->m_handler(cqe.res < 0
+            ? static_cast<uint32_t>(EPOLLERR) : static_cast<uint32_t>(cqe.res));
+        if (watch->m_fd >= 0 && !watch->m_polled) {
+            error = m_ring->poll_add(watch->m_fd, watch->m_events,
+                user_data(watch));
+            if (error != 0) {
+                m_removed.clear();
+                return error;
+            }
+            watch->m_polled = true;
+        }
+    }
+    m_removed.clear();
+    return 0;
+}
+
+} // namespace tuxlike
@@ -0,0 +1,186 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "timing_wheel.h"
+
+namespace tuxlike {
+
+class IoUring;
+
+/// How an `EventLoop` waits for its descriptors.
+enum class EventEngine {
+
+    /// io_uring if the kernel has what we need (Linux 5.13 or later,
+    /// for IORING_POLL_UPDATE_EVENTS), epoll otherwise.
+    Auto,
+
+    Epoll,
+
+    /// One-shot polls queued in an io_uring and re-armed as they
+    /// complete, all of them submitted with the wait of the next round.
+    IoUring,
+};
+
+/**
+ * Parses the name of an engine, as accepted by `--event-engine`.
+ *
+ * \return false if the name is not known.
+ */
+bool parse_event_engine(const char* name, EventEngine& engine);
+
+const char* event_engine_name(EventEngine engine);
+
+/**
+ * Dispatches readiness of file descriptors to handlers.
+ *
+ * With epoll, registering a descriptor is one `epoll_ctl`, and one
+ * `epoll_wait` serves any number of them. Deadlines live in a
+ * `TimingWheel` that drives a single timerfd, which is re-armed at
+ * most once per round.
+ *
+ * With io_uring, adding, changing and removing descriptors only
+ * queues operations; a round submits them and waits for completions
+ * in a single `io_uring_enter`, whose timeout is the next deadline of
+ * the wheel. Completions that are ready already are harvested without
+ * a system call. Either way, readiness is level-triggered.
+ *
+ * An event loop is used by a single thread.
+ */
+class EventLoop {
+public:
+
+    typedef std::function<void(uint32_t events)> Handler;
+
+    explicit EventLoop(EventEngine engine = EventEngine::Epoll);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * Calls `handler` whenever `fd` is ready for any of `events`
+     * (EPOLLIN, EPOLLOUT, ...).
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int add(int fd, uint32_t events, Handler handler);
+
+    /**
+     * Changes the events `fd` is watched for, keeping its handler.
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int modify(int fd, uint32_t events);
+
+    /**
+     * Stops watching `fd`, before it gets closed.
+     *
+     * It is safe to call this from within a handler.
+     */
+    void remove(int fd);
+
+    /**
+     * Calls `timer.m_callback` once CLOCK_MONOTONIC reaches `deadline`
+     * (in nanoseconds). Arming an armed timer moves its deadline.
+     */
+    void arm(Timer& timer, uint64_t deadline);
+
+    /// Disarms the timer, if armed.
+    void cancel(Timer& timer);
+
+    /**
+     * Calls `callback` once the handlers and timers of the current
+     * round have run, or at the end of the next round if no round is
+     * running. That round then does not wait for events.
+     */
+    void post(std::function<void()> callback);
+
+    /// The engine in use, never `Auto`.
+    EventEngine engine() const { return m_engine; }
+
+    /// The current CLOCK_MONOTONIC time in nanoseconds.
+    static uint64_t now();
+
+    /**
+     * Waits at most `timeout_ms` (-1 is forever) for some descriptors
+     * to become ready or timers to expire, and calls their handlers.
+     *
+     * \return 0 on success, or the `errno` describing the failure.
+     */
+    int run_once(int timeout_ms);
+
+private:
+
+    struct Watch {
+        int m_fd;
+        uint32_t m_events;
+        Handler m_handler;
+
+        /// Whether a poll of the ring is queued for it.
+        bool m_polled;
+    };
+
+    int open_epoll();
+    int wait_epoll(int timeout_ms);
+    int wait_ring(int timeout_ms);
+    void expire_timers();
+    void run_posted();
+
+    EventEngine m_engine;
+
+    /// Why the loop cannot run, or 0.
+    int m_error;
+
+    std::unique_ptr<IoUring> m_ring;
+
+    int m_epoll_fd;
+    int m_timer_fd;
+
+    TimingWheel m_wheel;
+
+    /// Deadline the timerfd is armed for.
+    uint64_t m_timer_fd_deadline;
+    std::unordered_map<int, std::unique_ptr<Watch>> m_watches;
+
+    /// Removed during dispatch; freed once the dispatch ends, as the
+    /// same batch of events may still point to them.
+    std::vector<std::unique_ptr<Watch>> m_removed;
+
+    /// Removed while polled by the ring; freed once the poll completes.
+    std::unordered_map<Watch*, std::unique_ptr<Watch>> m_retired;
+
+    std::vector<std::function<void()>> m_posted;
+};
+
+} // namespace tuxlike
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,270 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <signal.h>
+
+#include "job.h"
+
+namespace tuxlike {
+
+bool parse_duration(const std::string& text, uint64_t& duration_ns) {
+    static const struct {
+        const char* m_suffix;
+        uint64_t m_unit;
+    } units[] = {
+        { "ns", 1ULL },
+        { "us", 1000ULL },
+        { "ms", 1000000ULL },
+        { "s",  1000000000ULL },
+        { "m",  60 * 1000000000ULL },
+        { "h",  3600 * 1000000000ULL },
+        { "",   1000000ULL },
+    };
+
+    // Split into whole digits, fraction digits and the suffix.
+    size_t whole_end = text.find_first_not_of("0123456789");
+    if (whole_end == text.npos) {
+        whole_end = text.size();
+    }
+    size_t fraction_end = whole_end;
+    if (fraction_end < text.size() && text[fraction_end] == '.') {
+        fraction_end = text.find_first_not_of("0123456789", whole_end + 1);
+        if (fraction_end == text.npos) {
+            fraction_end = text.size();
+        }
+    }
+    if (whole_end == 0 && fraction_end <= whole_end + 1) {
+        return false;
+    }
+
+    std::string suffix = text.substr(fraction_end);
+    if (suffix.empty() && fraction_end == whole_end
+            && text == "4294967295") {
+        duration_ns = DURATION_INFINITE;
+        return true;
+    }
+
+    for (const auto& unit : units) {
+        if (suffix != unit.m_suffix) {
+            continue;
+        }
+
+        // Whole units, checking for overflow of the 64 bits.
+        uint64_t limit = (DURATION_INFINITE - 1) / unit.m_unit;
+        uint64_t value = 0;
+        for (size_t i = 0; i < whole_end; i++) {
+            uint64_t digit = text[i] - '0';
+            if (value > (limit - digit) / 10) {
+                return false;
+            }
+            value = value * 10 + digit;
+        }
+        value *= unit.m_unit;
+
+        // The fraction, exact down to the nanosecond.
+        uint64_t fraction = 0;
+        uint64_t scale = unit.m_unit;
+        for (size_t i = whole_end + 1; i < fraction_end && scale > 1; i++) {
+            scale /= 10;
+            fraction += (text[i] - '0') * scale;
+        }
+        if (fraction > DURATION_INFINITE - 1 - value) {
+            return false;
+        }
+        value += fraction;
+        duration_ns = value;
+        return true;
+    }
+    return false;
+}
+
+
+
+uint64_t duration_ns(std::chrono::nanoseconds timeout) {
+    if (timeout == std::chrono::nanoseconds::max()) {
+        return DURATION_INFINITE;
+    }
+    if (timeout.count() < 0) {
+        return 0;
+    }
+    return std::min<uint64_t>(timeout.count(), DURATION_INFINITE - 1);
+}
+
+
+
+bool parse_size(const std::string& text, size_t& bytes) {
+    size_t digits_end = text.find_first_not_of("0123456789");
+    if (digits_end == text.npos) {
+        digits_end = text.size();
+    }
+    if (digits_end == 0) {
+        return false;
+    }
+
+    std::string suffix = text.substr(digits_end);
+    size_t unit;
+    if (suffix.empty()) {
+        unit = 1;
+    } else if (suffix == "K") {
+        unit = 1024;
+    } else if (suffix == "M") {
+        unit = 1024 * 1024;
+    } else if (suffix == "G") {
+        unit = 1024 * 1024 * 1024;
+    } else {
+        return false;
+    }
+
+    size_t limit = SIZE_MAX / unit;
+    size_t value = 0;
+    for (size_t i = 0; i < digits_end; i++) {
+        size_t digit = text[i] - '0';
+        if (value > (limit - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    bytes = value * unit;
+    return true;
+}
+
+
+
+bool parse_signal(const std::string& text, int& signal) {
+    static const struct {
+        const char* m_name;
+        int m_signal;
+    } names[] = {
+        { "HUP",  SIGHUP  }, { "INT",  SIGINT  }, { "QUIT", SIGQUIT },
+        { "ABRT", SIGABRT }, { "KILL", SIGKILL }, { "USR1", SIGUSR1 },
+        { "USR2", SIGUSR2 }, { "PIPE", SIGPIPE }, { "ALRM", SIGALRM },
+        { "TERM", SIGTERM }, { "CONT", SIGCONT }, { "STOP", SIGSTOP },
+        { "TSTP", SIGTSTP }, { "XCPU", SIGXCPU }, { "WINCH", SIGWINCH },
+    };
+
+    const char* name = text.c_str();
+    if (strncmp(name, "SIG", 3) == 0) {
+        name += 3;
+    }
+    for (const auto& entry : names) {
+        if (strcmp(name, entry.m_name) == 0) {
+            signal = entry.m_signal;
+            return true;
+        }
+    }
+
+    try {
+        size_t used;
+        unsigned long number = std::stoul(text, &used);
+        if (used != text.size() || text[0] == '-'
+                || number == 0 || number >= (unsigned long) NSIG) {
+            return false;
+        }
+        signal = (int) number;
+        return true;
+    } catch(std::invalid_argument&) {
+        return false;
+    } catch(std::out_of_range&) {
+        return false;
+    }
+}
+
+
+
+/**
+ * Turns the fields of one record into a job.
+ */
+static bool make_job(std::vector<std::string>& fields, size_t record,
+    std::vector<Job>& jobs, std::string& error) {
+
+    if (fields.size() < 2) {
+        error = "Record " + std::to_string(record)
+            + " needs a TIMEOUT and a PROGRAM.";
+        return false;
+    }
+
+    Job job;
+    if (!parse_duration(fields[0], job.m_timeout_ns)) {
+        error = "Record " + std::to_string(record)
+            + ": the TIMEOUT must be a duration such as 1500, 1.5s or 250us.";
+        return false;
+    }
+    job.m_argv.assign(fields.begin() + 1, fields.end());
+    jobs.push_back(std::move(job));
+    fields.clear();
+    return true;
+}
+
+bool parse_manifest(const std::string& manifest, char delimiter,
+    std::vector<Job>& jobs, std::string& error) {
+
+    std::vector<std::string> fields;
+    size_t record = 1;
+
+    if (delimiter == '\0') {
+        size_t pos = 0;
+        while (pos < manifest.size()) {
+            size_t end = manifest.find('\0', pos);
+            if (end == manifest.npos) {
+                end = manifest.size();
+            }
+            if (end == pos) {
+                if (!make_job(fields, record++, jobs, error)) {
+                    return false;
+                }
+            } else {
+                fields.emplace_back(manifest, pos, end - pos);
+            }
+            pos = end + 1;
+        }
+        return fields.empty() || make_job(fields, record, jobs, error);
+    }
+
+    size_t pos = 0;
+    while (pos < manifest.size()) {
+        size_t end = manifest.find('\n', pos);
+        if (end == manifest.npos) {
+            end = manifest.size();
+        }
+        size_t field = manifest.find_first_not_of(" \t\r", pos);
+        while (field < end) {
+            size_t field_end = manifest.find_first_of(" \t\r\n", field);
+            if (field_end == manifest.npos) {
+                field_end = manifest.size();
+            }
+            fields.emplace_back(manifest, field, field_end - field);
+            field = manifest.find_first_not_of(" \t\r", field_end);
+        }
+        if (!fields.empty() && !make_job(fields, record, jobs, error)) {
+            return false;
+        }
+        record++;
+        pos = end + 1;
+    }
+    return true;
+}
+
+} // namespace tuxlike
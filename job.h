@@ -0,0 +1,118 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tuxlike {
+
+/// A duration that never runs out.
+#define DURATION_INFINITE UINT64_MAX
+
+/**
+ * A program to run together with its time limit.
+ */
+struct Job {
+
+    /// Program and its arguments; the program is searched in `PATH`.
+    std::vector<std::string> m_argv;
+
+    /// Time limit in nanoseconds, or `DURATION_INFINITE`.
+    uint64_t m_timeout_ns = DURATION_INFINITE;
+
+    /// If not `DURATION_INFINITE`, an absolute deadline on
+    /// CLOCK_MONOTONIC in nanoseconds, which applies instead of
+    /// `m_timeout_ns`; unlike the timeout it does not count from the
+    /// spawn, and one that passed already times out the job at once.
+    uint64_t m_deadline_ns = DURATION_INFINITE;
+
+    /// If not empty, the working directory of the job.
+    std::string m_cwd;
+
+    /// Run the job with `m_env` (`NAME=VALUE` strings) instead of
+    /// our environment.
+    bool m_replace_env = false;
+    std::vector<std::string> m_env;
+};
+
+/**
+ * Parses a duration such as `1500`, `1.5s` or `250us`.
+ *
+ * The number may have a fraction and one of the suffixes `ns`, `us`,
+ * `ms`, `s`, `m` or `h`; without a suffix it counts milliseconds.
+ * A plain `4294967295` stands for `DURATION_INFINITE`, as INFINITE
+ * does for WaitForSingleObject on Windows.
+ *
+ * \param[in] text the duration.
+ * \param[out] duration_ns receives the duration in nanoseconds.
+ * \return false if the text is not a duration or does not fit.
+ */
+bool parse_duration(const std::string& text, uint64_t& duration_ns);
+
+/**
+ * Converts a timeout into nanoseconds: `std::chrono::nanoseconds::max()`
+ * becomes `DURATION_INFINITE`, a negative one 0.
+ */
+uint64_t duration_ns(std::chrono::nanoseconds timeout);
+
+/**
+ * Parses a size in bytes such as `4096`, `64K` or `1M`; the suffixes
+ * `K`, `M` and `G` are powers of 1024.
+ *
+ * \return false if the text is not a size or does not fit.
+ */
+bool parse_size(const std::string& text, size_t& bytes);
+
+/**
+ * Parses a signal given by its name (`TERM`, `SIGTERM`) or number.
+ *
+ * \return false if there is no such signal.
+ */
+bool parse_signal(const std::string& text, int& signal);
+
+/**
+ * Splits a manifest into jobs.
+ *
+ * With `delimiter` set to '\n', every non-empty line holds one job
+ * as `TIMEOUT PROGRAM [ARGUMENTS...]`, separated by spaces or tabs.
+ * With `delimiter` set to '\0', every field is terminated by a NUL
+ * and an empty field ends the job, so arguments may contain blanks.
+ *
+ * \param[in] manifest the whole manifest.
+ * \param[in] delimiter either '\n' or '\0'.
+ * \param[out] jobs receives the jobs in manifest order.
+ * \param[out] error describes the first malformed record.
+ * \return false if a record is malformed.
+ */
+bool parse_manifest(const std::string& manifest, char delimiter,
+    std::vector<Job>& jobs, std::string& error);
+
+} // namespace tuxlike
+
+#endif // JOB_H
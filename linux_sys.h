@@ -0,0 +1,75 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef LINUX_SYS_H
+#define LINUX_SYS_H
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace tuxlike {
+
+inline int sys_pidfd_open(pid_t pid, unsigned int flags) {
+    return syscall(SYS_pidfd_open, pid, flags);
+}
+
+inline int sys_pidfd_send_signal(int pidfd, int sig) {
+    return syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+/// `waitid` that also returns the rusage, which the glibc one drops.
+inline int sys_waitid(int idtype, int id, siginfo_t* info, int options,
+    struct rusage* usage) {
+    return syscall(SYS_waitid, idtype, id, info, options, usage);
+}
+
+
+
+/**
+ * Closes a file descriptor in the destructor.
+ *
+ * The POSIX counterpart of `HandleGuard`.
+ */
+struct FdGuard {
+
+    int m_fd;
+
+    FdGuard(int fd)
+        : m_fd(fd) {}
+
+    ~FdGuard() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+};
+
+} // namespace tuxlike
+
+#endif // LINUX_SYS_H
@@ -0,0 +1,123 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cstdlib>
+#include <fstream>
+#include <sched.h>
+
+#include "placement.h"
+
+namespace tuxlike {
+
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus) {
+    std::vector<int> result;
+    const char* next = text.c_str();
+    for (;;) {
+        char* end;
+        long first = strtol(next, &end, 10);
+        if (end == next || *next == '-' || first >= CPU_SETSIZE) {
+            return false;
+        }
+        long last = first;
+        if (*end == '-') {
+            next = end + 1;
+            last = strtol(next, &end, 10);
+            if (end == next || *next == '-' || last < first
+                    || last >= CPU_SETSIZE) {
+                return false;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            result.push_back((int) cpu);
+        }
+
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        next = end + 1;
+    }
+    cpus.swap(result);
+    return true;
+}
+
+bool parse_sched_policy(const std::string& text, int& policy) {
+    if (text == "other") {
+        policy = SCHED_OTHER;
+    } else if (text == "batch") {
+        policy = SCHED_BATCH;
+    } else if (text == "idle") {
+        policy = SCHED_IDLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_io_priority(const std::string& text, int& priority) {
+    std::string name = text.substr(0, text.find(':'));
+    int io_class;
+    if (name == "realtime") {
+        io_class = IOPRIO_CLASS_RT;
+    } else if (name == "best-effort") {
+        io_class = IOPRIO_CLASS_BE;
+    } else if (name == "idle") {
+        io_class = IOPRIO_CLASS_IDLE;
+    } else {
+        return false;
+    }
+
+    // The idle class has no levels.
+    int level = io_class == IOPRIO_CLASS_IDLE ? 0 : 4;
+    if (name.size() < text.size()) {
+        std::string number = text.substr(name.size() + 1);
+        if (io_class == IOPRIO_CLASS_IDLE || number.size() != 1
+                || number[0] < '0' || number[0] > '7') {
+            return false;
+        }
+        level = number[0] - '0';
+    }
+    priority = IOPRIO_VALUE(io_class, level);
+    return true;
+}
+
+std::vector<int> numa_nodes() {
+    std::vector<int> nodes;
+    std::ifstream file("/sys/devices/system/node/has_memory");
+    std::string list;
+    if (!std::getline(file, list) || !parse_cpu_list(list, nodes)) {
+        nodes.clear();
+    }
+    return nodes;
+}
+
+bool numa_node_cpus(int node, std::vector<int>& cpus) {
+    std::ifstream file("/sys/devices/system/node/node"
+        + std::to_string(node) + "/cpulist");
+    std::string list;
+    return std::getline(file, list) && parse_cpu_list(list, cpus);
+}
+
+} // namespace tuxlike
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <string>
+#include <vector>
+
+namespace tuxlike {
+
+/// The `which` of `ioprio_set` for a single process.
+#define IOPRIO_WHO_PROCESS 1
+
+/// I/O priority classes of `ioprio_set`.
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+/// Packs a class and a level (0 to 7) into an I/O priority.
+#define IOPRIO_VALUE(class, level) (((class) << 13) | (level))
+
+/// NUMA nodes the memory of a child can be bound to.
+#define NUMA_MAX_NODES 1024
+
+/**
+ * Parses a list of CPUs such as `0-3,8,10-11`, the format of
+ * `taskset -c` and of the `cpulist` files in sysfs.
+ *
+ * \return false if the text is not such a list.
+ */
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus);
+
+/**
+ * Parses a scheduling policy: `other`, `batch` or `idle`.
+ *
+ * \return false if the name is not known.
+ */
+bool parse_sched_policy(const std::string& text, int& policy);
+
+/**
+ * Parses an I/O priority as `CLASS[:LEVEL]`, where CLASS is
+ * `realtime`, `best-effort` or `idle` and LEVEL is 0 (highest) to 7;
+ * 4 by default.
+ *
+ * \return false if the text is not such a priority.
+ */
+bool parse_io_priority(const std::string& text, int& priority);
+
+/**
+ * The online NUMA nodes that have memory, in ascending order; empty
+ * if the kernel has no NUMA support.
+ */
+std::vector<int> numa_nodes();
+
+/**
+ * Reads the CPUs of a NUMA node.
+ *
+ * \return false if there is no such node.
+ */
+bool numa_node_cpus(int node, std::vector<int>& cpus);
+
+} // namespace tuxlike
+
+#endif // PLACEMENT_H
@@ -0,0 +1,364 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "placement.h"
+#include "process_spawn.h"
+#include "tuxliketimeout.h"
+
+extern char** environ;
+
+namespace tuxlike {
+
+bool parse_spawn_strategy(const char* name, SpawnStrategy& strategy) {
+    if (strcmp(name, "posix_spawn") == 0) {
+        strategy = SpawnStrategy::PosixSpawn;
+    } else if (strcmp(name, "vfork") == 0) {
+        strategy = SpawnStrategy::Vfork;
+    } else if (strcmp(name, "fork") == 0) {
+        strategy = SpawnStrategy::Fork;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* spawn_strategy_name(SpawnStrategy strategy) {
+    switch (strategy) {
+        case SpawnStrategy::PosixSpawn: return "posix_spawn";
+        case SpawnStrategy::Vfork:      return "vfork";
+        case SpawnStrategy::Fork:       return "fork";
+    }
+    return "?";
+}
+
+
+
+/**
+ * Applies the scheduling and placement attributes in the child, see
+ * `setup_child`.
+ */
+static int place_child(const SpawnAttributes& attributes) {
+    if (attributes.m_sched_policy >= 0) {
+        // The policies we offer have no static priority.
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        if (sched_setscheduler(0, attributes.m_sched_policy, &param) < 0) {
+            return errno;
+        }
+    }
+    if (attributes.m_nice != 0) {
+        errno = 0;
+        if (nice(attributes.m_nice) == -1 && errno != 0) {
+            return errno;
+        }
+    }
+    if (attributes.m_io_priority >= 0 && syscall(SYS_ioprio_set,
+            IOPRIO_WHO_PROCESS, 0, attributes.m_io_priority) < 0) {
+        return errno;
+    }
+    if (attributes.m_cpus != NULL && sched_setaffinity(0,
+            sizeof(cpu_set_t), attributes.m_cpus) < 0) {
+        return errno;
+    }
+    if (attributes.m_numa_node >= 0) {
+        const size_t bits = 8 * sizeof(unsigned long);
+        unsigned long nodes[NUMA_MAX_NODES / bits];
+        memset(nodes, 0, sizeof(nodes));
+        nodes[attributes.m_numa_node / bits] |=
+            1UL << (attributes.m_numa_node % bits);
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, nodes,
+                NUMA_MAX_NODES + 1) < 0) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Applies the attributes in the child; only async-signal-safe calls
+ * are allowed here, as the child may share memory with the parent.
+ *
+ * \return 0 on success, or the `errno` describing the failure.
+ */
+static int setup_child(const SpawnAttributes& attributes) {
+    if (attributes.m_new_group && setpgid(0, 0) < 0) {
+        return errno;
+    }
+    if (attributes.m_stdout_fd >= 0
+            && dup2(attributes.m_stdout_fd, STDOUT_FILENO) < 0) {
+        return errno;
+    }
+    if (attributes.m_stderr_fd >= 0
+            && dup2(attributes.m_stderr_fd, STDERR_FILENO) < 0) {
+        return errno;
+    }
+    if (attributes.m_cgroup_procs_fd >= 0
+            && write(attributes.m_cgroup_procs_fd, "0", 1) < 0) {
+        return errno;
+    }
+    if (attributes.m_cwd != NULL && chdir(attributes.m_cwd) < 0) {
+        return errno;
+    }
+    if (attributes.m_address_space_limit != RLIM_INFINITY) {
+        struct rlimit limit = { attributes.m_address_space_limit,
+            attributes.m_address_space_limit };
+        if (setrlimit(RLIMIT_AS, &limit) < 0) {
+            return errno;
+        }
+    }
+    if (attributes.m_cpu_limit != RLIM_INFINITY) {
+        struct rlimit limit = { attributes.m_cpu_limit,
+            attributes.m_cpu_limit + 1 };
+        if (setrlimit(RLIMIT_CPU, &limit) < 0) {
+            return errno;
+        }
+    }
+    return place_child(attributes);
+}
+
+static char* const* envp_of(const SpawnAttributes& attributes) {
+    return attributes.m_envp != NULL ? attributes.m_envp : environ;
+}
+
+
+
+static int spawn_with_posix_spawn(char* const argv[],
+    const SpawnAttributes& attributes, pid_t& pid) {
+
+    posix_spawnattr_t attr;
+    int error = posix_spawnattr_init(&attr);
+    if (error != 0) {
+        return error;
+    }
+    if (attributes.m_new_group) {
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+
+    posix_spawn_file_actions_t actions;
+    error = posix_spawn_file_actions_init(&actions);
+    if (error != 0) {
+        posix_spawnattr_destroy(&attr);
+        return error;
+    }
+    if (attributes.m_stdout_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions,
+            attributes.m_stdout_fd, STDOUT_FILENO);
+    }
+    if (attributes.m_stderr_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions,
+            attributes.m_stderr_fd, STDERR_FILENO);
+    }
+    if (attributes.m_cwd != NULL) {
+        posix_spawn_file_actions_addchdir_np(&actions, attributes.m_cwd);
+    }
+
+    // glibc implements posix_spawnp with clone(CLONE_VM|CLONE_VFORK)
+    // and returns the errno of a failed exec.
+    error = posix_spawnp(&pid, argv[0], &actions, &attr, argv,
+        envp_of(attributes));
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return error;
+}
+
+
+
+/**
+ * State shared by the parent and the child of `clone(CLONE_VM)`.
+ */
+struct VforkContext {
+    char* const* m_argv;
+    const SpawnAttributes* m_attributes;
+    sigset_t m_sigmask;
+    int m_error;
+};
+
+/**
+ * Resets every signal the parent catches to SIG_DFL, as posix_spawn
+ * does: a handler of the parent must not run in a child that shares,
+ * or has a copy of, its memory. Signals must be blocked until then.
+ */
+static void reset_signal_handlers() {
+    struct sigaction action;
+    for (int sig = 1; sig < _NSIG; sig++) {
+        if (sigaction(sig, NULL, &action) != 0
+                || action.sa_handler == SIG_DFL
+                || action.sa_handler == SIG_IGN) {
+            continue;
+        }
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        sigaction(sig, &action, NULL);
+    }
+}
+
+static int vfork_child(void* arg) {
+    VforkContext* context = static_cast<VforkContext*>(arg);
+    reset_signal_handlers();
+    sigprocmask(SIG_SETMASK, &context->m_sigmask, NULL);
+    // The memory is shared, the parent reads the error after we exit.
+    context->m_error = setup_child(*context->m_attributes);
+    if (context->m_error == 0) {
+        execvpe(context->m_argv[0], context->m_argv,
+            envp_of(*context->m_attributes));
+        context->m_error = errno;
+    }
+    _exit(EXIT_CANNOT_INVOKE);
+}
+
+static int spawn_with_vfork(char* const argv[],
+    const SpawnAttributes& attributes, pid_t& pid) {
+
+    // execvpe builds candidate paths on the stack, leave room for them.
+    std::vector<char> stack(64 * 1024);
+
+    VforkContext context;
+    context.m_argv = argv;
+    context.m_attributes = &attributes;
+    context.m_error = 0;
+
+    // Signal handlers of the parent must not run on the child stack.
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &context.m_sigmask);
+
+    // The parent is suspended until the child execs or exits.
+    pid = clone(vfork_child, stack.data() + stack.size(),
+        CLONE_VM | CLONE_VFORK | SIGCHLD, &context);
+    int error = pid < 0 ? errno : 0;
+
+    pthread_sigmask(SIG_SETMASK, &context.m_sigmask, NULL);
+
+    if (error != 0) {
+        return error;
+    }
+    if (context.m_error != 0) {
+        waitpid(pid, NULL, 0);
+        return context.m_error;
+    }
+    return 0;
+}
+
+
+
+static int spawn_with_fork(char* const argv[],
+    const SpawnAttributes& attributes, pid_t& pid) {
+
+    // A close-on-exec pipe carries the errno of a failed exec back.
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+        return errno;
+    }
+
+    // No handler of ours may run in the child before it execs.
+    sigset_t all, mask;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &mask);
+
+    pid = fork();
+    if (pid < 0) {
+        int error = errno;
+        pthread_sigmask(SIG_SETMASK, &mask, NULL);
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return error;
+    }
+
+    if (pid == 0) {
+        reset_signal_handlers();
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        close(err_pipe[0]);
+        int error = setup_child(attributes);
+        if (error == 0) {
+            execvpe(argv[0], argv, envp_of(attributes));
+            error = errno;
+        }
+        ssize_t ignored = write(err_pipe[1], &error, sizeof(error));
+        (void) ignored;
+        _exit(EXIT_CANNOT_INVOKE);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    close(err_pipe[1]);
+    int error = 0;
+    ssize_t got;
+    do {
+        got = read(err_pipe[0], &error, sizeof(error));
+    } while (got < 0 && errno == EINTR);
+    close(err_pipe[0]);
+
+    if (got == sizeof(error)) {
+        waitpid(pid, NULL, 0);
+        return error;
+    }
+    return 0;
+}
+
+
+
+/**
+ * Whether the attributes need `setup_child`, beyond what `posix_spawn`
+ * does.
+ */
+static bool needs_setup_child(const SpawnAttributes& attributes) {
+    return attributes.m_cgroup_procs_fd >= 0
+        || attributes.m_address_space_limit != RLIM_INFINITY
+        || attributes.m_cpu_limit != RLIM_INFINITY
+        || attributes.m_cpus != NULL || attributes.m_numa_node >= 0
+        || attributes.m_nice != 0 || attributes.m_sched_policy >= 0
+        || attributes.m_io_priority >= 0;
+}
+
+int spawn_process(SpawnStrategy strategy, char* const argv[],
+    const SpawnAttributes& attributes, pid_t& pid) {
+
+    if (strategy == SpawnStrategy::PosixSpawn
+            && needs_setup_child(attributes)) {
+        strategy = SpawnStrategy::Vfork;
+    }
+
+    switch (strategy) {
+        case SpawnStrategy::PosixSpawn:
+            return spawn_with_posix_spawn(argv, attributes, pid);
+        case SpawnStrategy::Vfork:
+            return spawn_with_vfork(argv, attributes, pid);
+        case SpawnStrategy::Fork:
+            return spawn_with_fork(argv, attributes, pid);
+    }
+    return EINVAL;
+}
+
+} // namespace tuxlike
@@ -0,0 +1,130 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PROCESS_SPAWN_H
+#define PROCESS_SPAWN_H
+
+#include <cstddef>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+namespace tuxlike {
+
+/**
+ * How a child process is created.
+ *
+ * `PosixSpawn` and `Vfork` share the address space of the parent
+ * until the child execs, so their cost does not grow with the size
+ * of the supervisor. `Fork` copies the page tables and is kept as
+ * the reference implementation.
+ */
+enum class SpawnStrategy {
+    PosixSpawn,
+    Vfork,
+    Fork,
+};
+
+/**
+ * Parses the name of a strategy, as accepted by `--spawn`.
+ *
+ * \return false if the name is not known.
+ */
+bool parse_spawn_strategy(const char* name, SpawnStrategy& strategy);
+
+/**
+ * The name of the strategy, as accepted by `--spawn`.
+ */
+const char* spawn_strategy_name(SpawnStrategy strategy);
+
+/**
+ * What happens in the child before it execs.
+ */
+struct SpawnAttributes {
+
+    /// Make the child the leader of a new process group, so that
+    /// its whole tree can be signalled at once.
+    bool m_new_group = false;
+
+    /// If not negative, an open `cgroup.procs` the child moves itself
+    /// into. `posix_spawn` cannot do that, `vfork` is used instead.
+    int m_cgroup_procs_fd = -1;
+
+    /// If not negative, become the stdout of the child.
+    int m_stdout_fd = -1;
+
+    /// If not negative, become the stderr of the child.
+    int m_stderr_fd = -1;
+
+    /// If not NULL, the working directory of the child.
+    const char* m_cwd = NULL;
+
+    /// If not NULL, the environment of the child instead of ours.
+    /// The program is still searched in our `PATH`.
+    char* const* m_envp = NULL;
+
+    /// If not RLIM_INFINITY, the RLIMIT_AS of the child, in bytes.
+    /// `posix_spawn` cannot set limits, `vfork` is used instead.
+    rlim_t m_address_space_limit = RLIM_INFINITY;
+
+    /// If not RLIM_INFINITY, the RLIMIT_CPU of the child, in seconds.
+    /// SIGXCPU comes once it is reached, SIGKILL a second later.
+    rlim_t m_cpu_limit = RLIM_INFINITY;
+
+    /// If not NULL, the CPUs the child may run on.
+    const cpu_set_t* m_cpus = NULL;
+
+    /// If not negative, the NUMA node the memory of the child is
+    /// bound to.
+    int m_numa_node = -1;
+
+    /// Added to the niceness of the child.
+    int m_nice = 0;
+
+    /// If not negative, the scheduling policy of the child:
+    /// SCHED_OTHER, SCHED_BATCH or SCHED_IDLE.
+    int m_sched_policy = -1;
+
+    /// If not negative, the I/O priority of the child, see
+    /// `parse_io_priority`.
+    int m_io_priority = -1;
+};
+
+/**
+ * Starts `argv[0]` (searched in `PATH`) with the given arguments.
+ *
+ * Errors of the final `exec` are reported by the return value,
+ * so "not found" (ENOENT) can be told apart from other failures.
+ *
+ * \param[in] strategy selects how the child is created.
+ * \param[in] argv NULL-terminated argument vector of the child.
+ * \param[in] attributes are applied in the child before it execs.
+ * \param[out] pid receives the PID of the child.
+ * \return 0 on success, or the `errno` describing the failure.
+ */
+int spawn_process(SpawnStrategy strategy, char* const argv[],
+    const SpawnAttributes& attributes, pid_t& pid);
+
+} // namespace tuxlike
+
+#endif // PROCESS_SPAWN_H
@@ -0,0 +1,1239 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#include "capture.h"
+#include "cgroup.h"
+#include "event_loop.h"
+#include "linux_sys.h"
+#include "placement.h"
+#include "supervisor.h"
+#include "tuxliketimeout.h"
+
+namespace tuxlike {
+
+/**
+ * Translates the `siginfo_t` filled by `waitid` into an exit code.
+ *
+ * A child killed by a signal is reported as 128+SIGNAL, which is
+ * what a POSIX shell would report for it.
+ */
+static int exit_code_of(const siginfo_t& info) {
+    if (info.si_code == CLD_EXITED) {
+        return info.si_status;
+    }
+    return 128 + info.si_status;
+}
+
+static uint64_t nanoseconds_of(const struct timeval& time) {
+    return time.tv_sec * 1000000000ULL + time.tv_usec * 1000ULL;
+}
+
+static ResourceUsage usage_of(const struct rusage& usage) {
+    ResourceUsage result;
+    result.m_user_ns = nanoseconds_of(usage.ru_utime);
+    result.m_system_ns = nanoseconds_of(usage.ru_stime);
+    result.m_max_rss_bytes = usage.ru_maxrss * 1024ULL;
+    result.m_read_bytes = usage.ru_inblock * 512ULL;
+    result.m_write_bytes = usage.ru_oublock * 512ULL;
+    result.m_voluntary_switches = usage.ru_nvcsw;
+    result.m_involuntary_switches = usage.ru_nivcsw;
+    return result;
+}
+
+/**
+ * Whether a child with an RLIMIT_CPU of `limit_s` seconds died of it:
+ * of the SIGXCPU, or of the SIGKILL that follows if it ignored that.
+ */
+static bool cpu_limit_hit(const siginfo_t& info, const ResourceUsage& usage,
+    uint64_t limit_s) {
+    if (info.si_code == CLD_EXITED) {
+        return false;
+    }
+    return info.si_status == SIGXCPU || (info.si_status == SIGKILL
+        && usage.m_user_ns + usage.m_system_ns >= limit_s * 1000000000ULL);
+}
+
+/**
+ * Replaces what the rusage of the child tells about the job with what
+ * its cgroup accounted for the whole tree, where the cgroup has it.
+ */
+static void account(const Cgroup& cgroup, ResourceUsage& usage) {
+    uint64_t value;
+    if (cgroup.read_stat("cpu.stat", "user_usec", value)) {
+        usage.m_user_ns = value * 1000;
+    }
+    if (cgroup.read_stat("cpu.stat", "system_usec", value)) {
+        usage.m_system_ns = value * 1000;
+    }
+    if (cgroup.read_value("memory.peak", value)) {
+        usage.m_max_rss_bytes = value;
+    }
+    uint64_t read_bytes, write_bytes;
+    if (cgroup.read_io(read_bytes, write_bytes)) {
+        usage.m_read_bytes = read_bytes;
+        usage.m_write_bytes = write_bytes;
+    }
+}
+
+static void write_json(std::ostream& out, const std::string& text) {
+    static const char HEX[] = "0123456789abcdef";
+    out << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u00" << HEX[c >> 4] << HEX[c & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/**
+ * Writes the result of a job as a line of JSON, see
+ * `SupervisorOptions::m_report_path`. Jobs are numbered from 1.
+ */
+static void write_report(std::ostream& out, size_t index, const Job& job,
+    const JobResult& result) {
+
+    out << "{\"job\":" << index + 1 << ",\"argv\":[";
+    for (size_t i = 0; i < job.m_argv.size(); i++) {
+        out << (i == 0 ? "" : ",");
+        write_json(out, job.m_argv[i]);
+    }
+    const ResourceUsage& usage = result.m_usage;
+    out << "],\"exit_code\":" << result.m_exit_code
+        << ",\"timed_out\":" << (result.m_timed_out ? "true" : "false")
+        << ",\"wall_ns\":" << (result.m_reaped != 0
+            ? result.m_reaped - result.m_spawn_start : 0)
+        << ",\"user_ns\":" << usage.m_user_ns
+        << ",\"system_ns\":" << usage.m_system_ns
+        << ",\"max_rss_bytes\":" << usage.m_max_rss_bytes
+        << ",\"read_bytes\":" << usage.m_read_bytes
+        << ",\"write_bytes\":" << usage.m_write_bytes
+        << ",\"voluntary_switches\":" << usage.m_voluntary_switches
+        << ",\"involuntary_switches\":" << usage.m_involuntary_switches
+        << "}" << std::endl;
+}
+
+
+
+/// Serialises the diagnostics and `JobDone` calls of all workers.
+static std::mutex g_report_mutex;
+
+static void report(const std::string& message) {
+    std::lock_guard<std::mutex> lock(g_report_mutex);
+    std::cerr << message << std::endl;
+}
+
+
+
+class Worker;
+
+/**
+ * Where a job runs, see `Pool::placement`.
+ */
+struct Placement {
+
+    /// The NUMA node of its memory, or -1.
+    int m_numa_node;
+
+    /// Whether it is bound to `m_cpus`.
+    bool m_pinned;
+    cpu_set_t m_cpus;
+};
+
+/**
+ * The workers of one `run_jobs` call or `Supervisor` and their deques
+ * of jobs.
+ */
+class Pool {
+public:
+
+    /// A pool for a batch of jobs, see `run_jobs`.
+    Pool(const std::vector<Job>& jobs, const SupervisorOptions& options,
+        const JobDone& done);
+
+    /// A pool with a single worker for jobs yet to be submitted.
+    Pool(const SupervisorOptions& options, const JobDone& done);
+
+    ~Pool();
+
+    /// Opens the log and the like, problems are reported on stderr.
+    bool open();
+
+    std::vector<int> run();
+
+    /// Queues a job for the first worker. \return its index.
+    size_t submit(Job&& job);
+
+    /// How many submitted jobs are queued or running.
+    size_t submitted() const { return m_submitted.size() - m_free.size(); }
+
+    const Job& job(size_t job) const {
+        return m_batch != NULL ? (*m_batch)[job] : m_submitted[job];
+    }
+
+    Worker& first_worker() { return *m_workers[0]; }
+
+    /**
+     * Takes the next job for the given worker, from the front of its
+     * own deque, or from the back of the deque of another worker.
+     *
+     * \return false if no job is left anywhere.
+     */
+    bool take(size_t worker, size_t& job);
+
+    void finish(size_t job, const JobResult& result);
+
+    /// Finishes a job that could not be started.
+    void finish(size_t job, int exit_code);
+
+    /**
+     * The sinks of a stream of the child (STDOUT_FILENO or
+     * STDERR_FILENO), or nothing if the stream is not captured.
+     */
+    std::vector<Sink*> sinks(int stream) const;
+
+    /**
+     * Where the job runs, or NULL if it is not placed. The jobs are
+     * dealt round-robin to the NUMA nodes with `m_spread_numa`.
+     */
+    const Placement* placement(size_t job) const {
+        return m_placements.empty()
+            ? NULL : &m_placements[job % m_placements.size()];
+    }
+
+    bool captured() const {
+        return !m_options.m_log_path.empty() || m_options.m_tail_bytes > 0
+            || m_options.m_idle_timeout_ns != 0;
+    }
+
+    const SupervisorOptions m_options;
+
+    /// /dev/null, when the output is neither shown nor captured.
+    int m_null_fd;
+
+private:
+
+    bool place();
+
+    struct Deque {
+        std::mutex m_mutex;
+        std::deque<size_t> m_jobs;
+    };
+
+    const JobDone m_done;
+
+    /// The jobs of `run_jobs`, and their exit codes.
+    const std::vector<Job>* m_batch;
+    std::vector<int> m_exit_codes;
+
+    /// The jobs of a `Supervisor`, by index; finished jobs leave
+    /// their index to the next ones.
+    std::vector<Job> m_submitted;
+    std::vector<size_t> m_free;
+
+    int m_log_fd;
+
+    /// Where `write_report` goes, if anywhere.
+    std::ostream* m_report;
+    std::unique_ptr<std::ofstream> m_report_file;
+
+    std::unique_ptr<Sink> m_stdout_sink;
+    std::unique_ptr<Sink> m_stderr_sink;
+    std::unique_ptr<Sink> m_log_sink;
+
+    std::vector<Placement> m_placements;
+
+    std::vector<std::unique_ptr<Deque>> m_deques;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+
+
+/// How many jobs a worker starts before it looks at its event loop.
+#define START_BATCH 16
+
+/// The shortest interval between two polls of the CPU time of a job.
+#define CPU_POLL_NS 1000000ULL
+
+/// How long a cgroup killed one process at a time (before Linux 5.14)
+/// may stay populated before its members are killed again.
+#define KILL_RETRY_NS 10000000ULL
+
+/**
+ * Supervises up to `slots` children in one event loop.
+ */
+class Worker {
+public:
+
+    Worker(Pool& pool, size_t id, unsigned slots)
+        : m_pool(pool), m_id(id), m_slots(slots),
+          m_cpus(std::max(std::thread::hardware_concurrency(), 1u)),
+          m_loop(pool.m_options.m_engine) {}
+
+    /// Runs jobs until none is left.
+    void run();
+
+    /**
+     * Starts jobs while slots are free and dispatches one round of
+     * events.
+     *
+     * \return 0 on success, or the `errno` of the event loop.
+     */
+    int run_once();
+
+    EventLoop& loop() { return m_loop; }
+
+private:
+
+    struct Child {
+        size_t m_job;
+        pid_t m_pid;
+        int m_pidfd;
+        Timer m_timer;
+        uint64_t m_spawn_start;
+        uint64_t m_spawn_end;
+        uint64_t m_deadline;
+        uint64_t m_signalled;
+        uint64_t m_reaped_at;
+        Timer m_idle_timer;
+        Timer m_cpu_timer;
+        Timer m_kill_timer;
+        uint64_t m_last_output;
+        ResourceUsage m_usage;
+        rlim_t m_cpu_limit;
+        std::unique_ptr<Cgroup> m_cgroup;
+        std::unique_ptr<TailSink> m_tail;
+        std::unique_ptr<OutputPump> m_output[2];
+        bool m_timed_out;
+        bool m_killed;
+        bool m_reaped;
+        int m_exit_code;
+    };
+
+    bool start_jobs();
+    int wait(int timeout_ms);
+    void start(size_t job);
+    bool watch(Child& child);
+    void drain(Child& child, OutputPump& pump, uint32_t events);
+    void dump_tail(const Child& child);
+    void reap(Child& child);
+    void expire(Child& child);
+    void expire_idle(Child& child);
+    void expire_cpu(Child& child);
+    uint64_t cpu_poll_delay(uint64_t cpu_time_left) const;
+    void signal(Child& child, int sig);
+    void kill_tree(Child& child);
+    void finish(Child& child);
+    void abort(Child& child);
+
+    Pool& m_pool;
+    size_t m_id;
+    unsigned m_slots;
+
+    /// How fast the CPU time of a job can grow, at most.
+    unsigned m_cpus;
+
+    EventLoop m_loop;
+
+    /// Running children, by pidfd.
+    std::unordered_map<int, Child> m_children;
+};
+
+void Worker::run() {
+    for (;;) {
+        bool more = start_jobs();
+        if (m_children.empty() && !more) {
+            break;
+        }
+        wait(more ? 0 : -1);
+    }
+}
+
+int Worker::run_once() {
+    return wait(start_jobs() ? 0 : -1);
+}
+
+/**
+ * Starts jobs while slots are free, but no more than `START_BATCH`,
+ * so that the deadlines of the running ones are not held up.
+ *
+ * \return whether there may be more jobs to start right away.
+ */
+bool Worker::start_jobs() {
+    size_t job;
+    for (unsigned started = 0; m_children.size() < m_slots; started++) {
+        if (started == START_BATCH) {
+            return true;
+        }
+        if (!m_pool.take(m_id, job)) {
+            return false;
+        }
+        start(job);
+    }
+    return false;
+}
+
+/**
+ * Dispatches one round of events; gives up on all children if the
+ * event loop fails.
+ */
+int Worker::wait(int timeout_ms) {
+    int error = m_loop.run_once(timeout_ms);
+    if (error != 0) {
+        report(std::string("epoll_wait failed. (")
+            + strerror(error) + ")");
+        while (!m_children.empty()) {
+            abort(m_children.begin()->second);
+        }
+    }
+    return error;
+}
+
+void Worker::start(size_t job) {
+
+    const Job& spec = m_pool.job(job);
+    const SupervisorOptions& options = m_pool.m_options;
+
+    std::vector<char*> job_argv;
+    for (const std::string& arg : spec.m_argv) {
+        job_argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    job_argv.push_back(NULL);
+
+    std::vector<char*> job_envp;
+    for (const std::string& variable : spec.m_env) {
+        job_envp.push_back(const_cast<char*>(variable.c_str()));
+    }
+    job_envp.push_back(NULL);
+
+    SpawnAttributes attributes;
+    attributes.m_new_group = options.m_new_group;
+    attributes.m_nice = options.m_nice;
+    attributes.m_sched_policy = options.m_sched_policy;
+    attributes.m_io_priority = options.m_io_priority;
+    const Placement* placement = m_pool.placement(job);
+    if (placement != NULL) {
+        attributes.m_numa_node = placement->m_numa_node;
+        if (placement->m_pinned) {
+            attributes.m_cpus = &placement->m_cpus;
+        }
+    }
+    if (!spec.m_cwd.empty()) {
+        attributes.m_cwd = spec.m_cwd.c_str();
+    }
+    if (spec.m_replace_env) {
+        attributes.m_envp = job_envp.data();
+    }
+
+    std::unique_ptr<Cgroup> cgroup;
+    if (!options.m_cgroup_parent.empty()) {
+        cgroup.reset(new Cgroup);
+        std::string name = "tuxlike-" + std::to_string(getpid())
+            + "-" + std::to_string(job + 1);
+        int error = cgroup->create(options.m_cgroup_parent, name);
+        if (error != 0) {
+            report("Cannot create cgroup '" + options.m_cgroup_parent
+                + "/" + name + "'. (" + strerror(error) + ")");
+            m_pool.finish(job, EXIT_CANCELED);
+            return;
+        }
+        attributes.m_cgroup_procs_fd = cgroup->procs_fd();
+    }
+
+    if (options.m_memory_limit != 0) {
+        if (cgroup && cgroup->set("memory.max",
+                std::to_string(options.m_memory_limit)) == 0) {
+            // Swapping would only put off the OOM kill, and slow down
+            // everything else on the way.
+            cgroup->set("memory.swap.max", "0");
+        } else {
+            attributes.m_address_space_limit = options.m_memory_limit;
+        }
+    }
+
+    // The cgroup accounts the whole tree, see `expire_cpu`.
+    if (options.m_cpu_timeout_ns != 0 && !cgroup) {
+        attributes.m_cpu_limit =
+            (options.m_cpu_timeout_ns + 999999999ULL) / 1000000000ULL;
+    }
+
+    std::unique_ptr<TailSink> tail;
+    if (options.m_tail_bytes > 0) {
+        tail.reset(new TailSink(options.m_tail_bytes));
+    }
+
+    std::unique_ptr<OutputPump> output[2];
+    if (m_pool.captured()) {
+        for (int stream = 0; stream < 2; stream++) {
+            // Both streams share the tail, in the order they were written.
+            std::vector<Sink*> sinks = m_pool.sinks(STDOUT_FILENO + stream);
+            if (tail) {
+                sinks.push_back(tail.get());
+            }
+            output[stream].reset(new OutputPump);
+            int error = output[stream]->open(sinks);
+            if (error != 0) {
+                report(std::string("Cannot create a pipe. (")
+                    + strerror(error) + ")");
+                m_pool.finish(job, EXIT_CANCELED);
+                return;
+            }
+        }
+        attributes.m_stdout_fd = output[0]->write_fd();
+        attributes.m_stderr_fd = output[1]->write_fd();
+    } else if (options.m_quiet) {
+        attributes.m_stdout_fd = m_pool.m_null_fd;
+        attributes.m_stderr_fd = m_pool.m_null_fd;
+    }
+
+    uint64_t spawn_start = EventLoop::now();
+    pid_t pid;
+    int error = spawn_process(options.m_spawn, job_argv.data(),
+        attributes, pid);
+    uint64_t spawn_end = EventLoop::now();
+    for (auto& pump : output) {
+        if (pump) {
+            pump->close_write();
+        }
+    }
+    if (options.m_verbose) {
+        std::ostringstream message;
+        message << "Spawn took " << (spawn_end - spawn_start) / 1000;
+        message << " us (" << spawn_strategy_name(options.m_spawn) << ").";
+        report(message.str());
+    }
+
+    switch (error) {
+
+        case 0:
+            break;
+
+        case ENOENT:
+            report("Command '" + spec.m_argv[0] + "' not found.");
+            m_pool.finish(job, EXIT_ENOENT);
+            return;
+
+        default:
+            report("Cannot execute '" + spec.m_argv[0] + "'. ("
+                + strerror(error) + ")");
+            m_pool.finish(job, EXIT_CANNOT_INVOKE);
+            return;
+    }
+
+    // The child is not reaped until we call waitid, so its PID cannot
+    // be recycled and the pidfd is guaranteed to refer to it.
+    int pidfd = sys_pidfd_open(pid, 0);
+    if (pidfd < 0) {
+        report(std::string("pidfd_open failed. (") + strerror(errno) + ")");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        m_pool.finish(job, EXIT_CANCELED);
+        return;
+    }
+
+    Child& child = m_children[pidfd];
+    child.m_job = job;
+    child.m_pid = pid;
+    child.m_pidfd = pidfd;
+    child.m_cgroup = std::move(cgroup);
+    child.m_tail = std::move(tail);
+    child.m_output[0] = std::move(output[0]);
+    child.m_output[1] = std::move(output[1]);
+    child.m_spawn_start = spawn_start;
+    child.m_spawn_end = spawn_end;
+    child.m_deadline = 0;
+    child.m_signalled = 0;
+    child.m_reaped_at = 0;
+    child.m_usage = ResourceUsage();
+    child.m_cpu_limit = attributes.m_cpu_limit;
+    child.m_timed_out = false;
+    child.m_killed = false;
+    child.m_reaped = false;
+    child.m_exit_code = EXIT_CANCELED;
+
+    if (!watch(child)) {
+        abort(child);
+        return;
+    }
+
+    child.m_timer.m_callback = [this, &child]() {
+        expire(child);
+    };
+    if (spec.m_deadline_ns != DURATION_INFINITE) {
+        child.m_deadline = spec.m_deadline_ns;
+        m_loop.arm(child.m_timer, child.m_deadline);
+    } else if (spec.m_timeout_ns != DURATION_INFINITE) {
+        child.m_deadline = spawn_end + std::min(spec.m_timeout_ns,
+            DURATION_INFINITE - 1 - spawn_end);
+        m_loop.arm(child.m_timer, child.m_deadline);
+    }
+
+    if (options.m_idle_timeout_ns != 0) {
+        child.m_last_output = spawn_end;
+        child.m_idle_timer.m_callback = [this, &child]() {
+            expire_idle(child);
+        };
+        m_loop.arm(child.m_idle_timer, spawn_end + std::min(
+            options.m_idle_timeout_ns, DURATION_INFINITE - 1 - spawn_end));
+    }
+
+    if (options.m_cpu_timeout_ns != 0 && child.m_cgroup) {
+        child.m_cpu_timer.m_callback = [this, &child]() {
+            expire_cpu(child);
+        };
+        m_loop.arm(child.m_cpu_timer,
+            spawn_end + cpu_poll_delay(options.m_cpu_timeout_ns));
+    }
+}
+
+/**
+ * Registers the descriptors of the child in the event loop.
+ */
+bool Worker::watch(Child& child) {
+
+    // The pidfd becomes readable when the child terminates.
+    int error = m_loop.add(child.m_pidfd, EPOLLIN, [this, &child](uint32_t) {
+        reap(child);
+    });
+
+    // cgroup.events signals a change of its "populated" line.
+    if (error == 0 && child.m_cgroup) {
+        error = m_loop.add(child.m_cgroup->events_fd(), EPOLLPRI,
+            [this, &child](uint32_t) {
+                // Reading acknowledges the event, which repeats otherwise.
+                bool populated = child.m_cgroup->populated();
+                if (child.m_reaped && !populated) {
+                    finish(child);
+                }
+            });
+    }
+
+    for (auto& output : child.m_output) {
+        if (error == 0 && output) {
+            OutputPump& pump = *output;
+            error = m_loop.add(pump.read_fd(), EPOLLIN,
+                [this, &child, &pump](uint32_t events) {
+                    drain(child, pump, events);
+                });
+        }
+    }
+
+    if (error != 0) {
+        report(std::string("epoll_ctl failed. (") + strerror(error) + ")");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Moves the output of the child into the sinks; stops watching the
+ * pipe once all its writers are gone.
+ */
+void Worker::drain(Child& child, OutputPump& pump, uint32_t events) {
+    if (events & EPOLLIN) {
+        // The idle timer catches up with this when it fires, which
+        // keeps a chatty child from costing a timer update per write.
+        child.m_last_output = EventLoop::now();
+    }
+    int error = pump.pump();
+    if (error != 0) {
+        report(std::string("Cannot pass the output on. (")
+            + strerror(error) + ")");
+        m_loop.remove(pump.read_fd());
+        return;
+    }
+    if ((events & (EPOLLHUP | EPOLLERR)) && pump.empty()) {
+        m_loop.remove(pump.read_fd());
+    }
+}
+
+void Worker::reap(Child& child) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    struct rusage usage;
+    if (sys_waitid(P_PIDFD, child.m_pidfd, &info, WEXITED, &usage) < 0) {
+        report(std::string("waitid failed. (") + strerror(errno) + ")");
+        child.m_exit_code = EXIT_CANCELED;
+    } else {
+        child.m_usage = usage_of(usage);
+        if (child.m_cpu_limit != RLIM_INFINITY
+                && cpu_limit_hit(info, child.m_usage, child.m_cpu_limit)) {
+            child.m_timed_out = true;
+        }
+        child.m_exit_code = child.m_killed ? 128 + SIGKILL
+            : child.m_timed_out ? EXIT_TIMEDOUT : exit_code_of(info);
+    }
+    child.m_reaped_at = EventLoop::now();
+    child.m_reaped = true;
+    m_loop.remove(child.m_pidfd);
+    m_loop.cancel(child.m_timer);
+    m_loop.cancel(child.m_idle_timer);
+    m_loop.cancel(child.m_cpu_timer);
+
+    // All the child wrote is in the pipes by now. Whatever its
+    // descendants write later is lost, the job is over.
+    for (auto& output : child.m_output) {
+        if (output) {
+            output->pump();
+            m_loop.remove(output->read_fd());
+        }
+    }
+
+    // The cgroup lives as long as the job; whatever is left in it
+    // gets killed and the job ends once the cgroup is empty.
+    if (child.m_cgroup) {
+        kill_tree(child);
+        if (child.m_cgroup->populated()) {
+            return;
+        }
+    }
+    finish(child);
+}
+
+/**
+ * Signals the whole process group of the child, or just the child
+ * if it does not lead a group.
+ */
+void Worker::signal(Child& child, int sig) {
+    int result;
+    if (m_pool.m_options.m_new_group) {
+        // The unreaped leader keeps the group ID from being reused.
+        result = kill(-child.m_pid, sig);
+    } else {
+        result = sys_pidfd_send_signal(child.m_pidfd, sig);
+    }
+    if (result < 0 && errno != ESRCH) {
+        report(std::string("Sending a signal failed. (")
+            + strerror(errno) + ")");
+    }
+}
+
+/**
+ * Kills the whole tree of the child, including the processes
+ * that left its process group.
+ */
+void Worker::kill_tree(Child& child) {
+    if (!child.m_cgroup) {
+        signal(child, SIGKILL);
+        return;
+    }
+    int error = child.m_cgroup->kill();
+    if (error == EINPROGRESS) {
+        // Unless cgroup.events reports it empty first, kill whatever
+        // was forked in the meantime.
+        child.m_kill_timer.m_callback = [this, &child]() {
+            if (child.m_cgroup->populated()) {
+                kill_tree(child);
+            } else if (child.m_reaped) {
+                finish(child);
+            }
+        };
+        m_loop.arm(child.m_kill_timer, EventLoop::now() + KILL_RETRY_NS);
+        return;
+    }
+    if (error != 0) {
+        report("Cannot kill cgroup '" + child.m_cgroup->path() + "'. ("
+            + strerror(error) + ")");
+    }
+}
+
+void Worker::expire(Child& child) {
+    const SupervisorOptions& options = m_pool.m_options;
+    if (!child.m_timed_out) {
+        child.m_signalled = EventLoop::now();
+    }
+
+    if (options.m_verbose && !child.m_timed_out) {
+        uint64_t overshoot = child.m_signalled - child.m_deadline;
+        std::ostringstream message;
+        message << "Deadline of job " << (child.m_job + 1)
+            << " overshot by " << overshoot / 1000 << "."
+            << std::setw(3) << std::setfill('0') << overshoot % 1000
+            << " us.";
+        report(message.str());
+    }
+
+    if (child.m_timed_out || options.m_signal == SIGKILL) {
+        // Either the grace period is over as well, or there is none.
+        kill_tree(child);
+        child.m_killed = child.m_timed_out;
+        child.m_timed_out = true;
+        return;
+    }
+
+    // Reaped once the pidfd reports the death.
+    child.m_timed_out = true;
+    signal(child, options.m_signal);
+    if (options.m_signal != SIGCONT) {
+        // A stopped child would not act on the signal otherwise.
+        signal(child, SIGCONT);
+    }
+
+    if (options.m_kill_after_ns != 0) {
+        m_loop.arm(child.m_timer, EventLoop::now() + std::min(
+            options.m_kill_after_ns, DURATION_INFINITE - 1 - EventLoop::now()));
+    }
+}
+
+/**
+ * Fires when the child might have been silent for the idle timeout;
+ * moves on to the actual end of the silence if it was not.
+ */
+void Worker::expire_idle(Child& child) {
+    uint64_t idle_timeout = m_pool.m_options.m_idle_timeout_ns;
+    uint64_t deadline = child.m_last_output + std::min(idle_timeout,
+        DURATION_INFINITE - 1 - child.m_last_output);
+    if (deadline > EventLoop::now()) {
+        m_loop.arm(child.m_idle_timer, deadline);
+        return;
+    }
+
+    // From here on it is the same as running out of time; the grace
+    // period, if any, is measured by the regular timer.
+    if (!child.m_timed_out) {
+        m_loop.cancel(child.m_timer);
+        child.m_deadline = deadline;
+        expire(child);
+    }
+}
+
+/**
+ * How long a job with `cpu_time_left` takes at least to use it up,
+ * when it keeps every CPU busy.
+ */
+uint64_t Worker::cpu_poll_delay(uint64_t cpu_time_left) const {
+    uint64_t delay = std::max<uint64_t>(cpu_time_left / m_cpus, CPU_POLL_NS);
+    return std::min(delay, DURATION_INFINITE - 1 - EventLoop::now());
+}
+
+/**
+ * Fires when the job might have used up its CPU time; polls again
+ * once it might have, if it has not yet.
+ */
+void Worker::expire_cpu(Child& child) {
+    uint64_t cpu_timeout = m_pool.m_options.m_cpu_timeout_ns;
+    uint64_t usage_us = 0;
+    child.m_cgroup->read_stat("cpu.stat", "usage_usec", usage_us);
+    uint64_t now = EventLoop::now();
+    if (usage_us * 1000 < cpu_timeout) {
+        m_loop.arm(child.m_cpu_timer,
+            now + cpu_poll_delay(cpu_timeout - usage_us * 1000));
+        return;
+    }
+
+    if (!child.m_timed_out) {
+        m_loop.cancel(child.m_timer);
+        child.m_deadline = now;
+        expire(child);
+    }
+}
+
+/**
+ * Reports the job of a reaped child and forgets the child.
+ */
+void Worker::finish(Child& child) {
+    size_t job = child.m_job;
+    int exit_code = child.m_exit_code;
+    int pidfd = child.m_pidfd;
+
+    // A job that fails after the kernel killed any of its processes
+    // for exceeding memory.max ran out of memory.
+    uint64_t oom_kills = 0;
+    if (child.m_cgroup && exit_code != 0 && !child.m_timed_out
+            && exit_code != EXIT_CANCELED
+            && child.m_cgroup->read_stat("memory.events", "oom_kill",
+                oom_kills)
+            && oom_kills > 0) {
+        exit_code = EXIT_OOM;
+    }
+
+    JobResult result;
+    result.m_exit_code = exit_code;
+    result.m_timed_out = child.m_timed_out;
+    result.m_killed = child.m_killed;
+    result.m_spawn_start = child.m_spawn_start;
+    result.m_spawn_end = child.m_spawn_end;
+    result.m_deadline = child.m_deadline;
+    result.m_signalled = child.m_signalled;
+    result.m_reaped = child.m_reaped_at;
+    if (child.m_cgroup) {
+        account(*child.m_cgroup, child.m_usage);
+        m_loop.remove(child.m_cgroup->events_fd());
+        m_loop.cancel(child.m_kill_timer);
+    }
+    result.m_usage = child.m_usage;
+    for (auto& output : child.m_output) {
+        if (output) {
+            m_loop.remove(output->read_fd());
+        }
+    }
+    if (child.m_tail && (child.m_timed_out || exit_code != 0)) {
+        dump_tail(child);
+    }
+    close(pidfd);
+    m_children.erase(pidfd);
+    m_pool.finish(job, result);
+}
+
+/**
+ * Shows the last output of a job that failed or timed out.
+ */
+void Worker::dump_tail(const Child& child) {
+    std::string tail = child.m_tail->contents();
+    std::lock_guard<std::mutex> lock(g_report_mutex);
+    std::cerr << "Last " << tail.size() << " of " << child.m_tail->total();
+    std::cerr << " bytes of output of job " << child.m_job + 1 << ":";
+    std::cerr << std::endl << tail;
+    if (!tail.empty() && tail.back() != '\n') {
+        std::cerr << std::endl;
+    }
+    std::cerr.flush();
+}
+
+/**
+ * Gives up on the child after an internal error.
+ */
+void Worker::abort(Child& child) {
+    if (!child.m_reaped) {
+        m_loop.remove(child.m_pidfd);
+        m_loop.cancel(child.m_timer);
+        m_loop.cancel(child.m_idle_timer);
+        m_loop.cancel(child.m_cpu_timer);
+        kill_tree(child);
+        waitpid(child.m_pid, NULL, 0);
+    } else if (child.m_cgroup) {
+        kill_tree(child);
+    }
+    child.m_exit_code = EXIT_CANCELED;
+    finish(child);
+}
+
+
+
+Pool::Pool(const std::vector<Job>& jobs, const SupervisorOptions& options,
+    const JobDone& done)
+    : m_options(options), m_null_fd(-1), m_done(done), m_batch(&jobs),
+      m_exit_codes(jobs.size(), EXIT_CANCELED), m_log_fd(-1),
+      m_report(NULL) {
+
+    unsigned parallel = std::max(options.m_parallel, 1u);
+    size_t workers = std::min<size_t>(parallel, jobs.size());
+    workers = std::min<size_t>(workers,
+        std::max(std::thread::hardware_concurrency(), 1u));
+    workers = std::max<size_t>(workers, 1);
+
+    for (size_t i = 0; i < workers; i++) {
+        unsigned slots = parallel / workers + (i < parallel % workers);
+        m_deques.emplace_back(new Deque);
+        m_workers.emplace_back(new Worker(*this, i, slots));
+    }
+
+    // Deal the jobs round-robin, each worker starts in manifest order.
+    for (size_t job = 0; job < jobs.size(); job++) {
+        m_deques[job % workers]->m_jobs.push_back(job);
+    }
+}
+
+Pool::Pool(const SupervisorOptions& options, const JobDone& done)
+    : m_options(options), m_null_fd(-1), m_done(done), m_batch(NULL),
+      m_log_fd(-1), m_report(NULL) {
+    m_deques.emplace_back(new Deque);
+    m_workers.emplace_back(new Worker(*this, 0,
+        std::max(options.m_parallel, 1u)));
+}
+
+Pool::~Pool() {
+    // The writers of the sinks may still flush into the descriptors.
+    m_workers.clear();
+    m_stdout_sink.reset();
+    m_stderr_sink.reset();
+    m_log_sink.reset();
+    if (m_log_fd >= 0) {
+        close(m_log_fd);
+    }
+    if (m_null_fd >= 0) {
+        close(m_null_fd);
+    }
+}
+
+std::vector<Sink*> Pool::sinks(int stream) const {
+    std::vector<Sink*> sinks;
+    if (!m_options.m_quiet && m_options.m_tail_bytes == 0) {
+        sinks.push_back(stream == STDOUT_FILENO
+            ? m_stdout_sink.get() : m_stderr_sink.get());
+    }
+    if (m_log_sink) {
+        sinks.push_back(m_log_sink.get());
+    }
+    return sinks;
+}
+
+bool Pool::open() {
+    if (!m_options.m_log_path.empty()) {
+        // Not O_APPEND, splice() refuses to write to such files.
+        m_log_fd = ::open(m_options.m_log_path.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (m_log_fd < 0) {
+            report("Cannot write '" + m_options.m_log_path + "'. ("
+                + strerror(errno) + ")");
+            return false;
+        }
+        m_log_sink.reset(new Sink(m_log_fd));
+    }
+    if (m_options.m_report_path == "-") {
+        m_report = &std::cerr;
+    } else if (!m_options.m_report_path.empty()) {
+        m_report_file.reset(new std::ofstream(m_options.m_report_path));
+        if (!*m_report_file) {
+            report("Cannot write '" + m_options.m_report_path + "'.");
+            return false;
+        }
+        m_report = m_report_file.get();
+    }
+    if (!place()) {
+        return false;
+    }
+    m_stdout_sink.reset(new Sink(STDOUT_FILENO));
+    m_stderr_sink.reset(new Sink(STDERR_FILENO));
+    if (m_options.m_quiet) {
+        m_null_fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    return true;
+}
+
+/**
+ * Works out the `Placement` of the jobs.
+ */
+bool Pool::place() {
+    std::vector<int> nodes;
+    if (m_options.m_spread_numa) {
+        nodes = numa_nodes();
+    } else if (m_options.m_numa_node >= 0) {
+        std::vector<int> all = numa_nodes();
+        if (std::find(all.begin(), all.end(), m_options.m_numa_node)
+                == all.end()) {
+            report("There is no NUMA node " + std::to_string(
+                m_options.m_numa_node) + " with memory.");
+            return false;
+        }
+        nodes.push_back(m_options.m_numa_node);
+    }
+    if (nodes.empty()) {
+        nodes.push_back(-1);
+    }
+
+    for (int node : nodes) {
+        Placement placement;
+        placement.m_numa_node = node;
+        std::vector<int> cpus = m_options.m_cpus;
+        if (cpus.empty() && node >= 0) {
+            // A node may have memory, but no CPUs.
+            numa_node_cpus(node, cpus);
+        }
+        placement.m_pinned = !cpus.empty();
+        CPU_ZERO(&placement.m_cpus);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &placement.m_cpus);
+        }
+        if (placement.m_pinned || node >= 0) {
+            m_placements.push_back(placement);
+        }
+    }
+    return true;
+}
+
+std::vector<int> Pool::run() {
+    if (!open()) {
+        return std::move(m_exit_codes);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < m_workers.size(); i++) {
+        threads.emplace_back(&Worker::run, m_workers[i].get());
+    }
+    m_workers[0]->run();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return std::move(m_exit_codes);
+}
+
+bool Pool::take(size_t worker, size_t& job) {
+    {
+        Deque& own = *m_deques[worker];
+        std::lock_guard<std::mutex> lock(own.m_mutex);
+        if (!own.m_jobs.empty()) {
+            job = own.m_jobs.front();
+            own.m_jobs.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < m_deques.size(); i++) {
+        Deque& victim = *m_deques[(worker + i) % m_deques.size()];
+        std::lock_guard<std::mutex> lock(victim.m_mutex);
+        if (!victim.m_jobs.empty()) {
+            job = victim.m_jobs.back();
+            victim.m_jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t Pool::submit(Job&& job) {
+    size_t index;
+    if (m_free.empty()) {
+        index = m_submitted.size();
+        m_submitted.push_back(std::move(job));
+    } else {
+        index = m_free.back();
+        m_free.pop_back();
+        m_submitted[index] = std::move(job);
+    }
+
+    Deque& deque = *m_deques[0];
+    std::lock_guard<std::mutex> lock(deque.m_mutex);
+    deque.m_jobs.push_back(index);
+    return index;
+}
+
+void Pool::finish(size_t job, int exit_code) {
+    JobResult result;
+    result.m_exit_code = exit_code;
+    finish(job, result);
+}
+
+void Pool::finish(size_t job, const JobResult& result) {
+    if (m_batch != NULL) {
+        m_exit_codes[job] = result.m_exit_code;
+    }
+    if (m_done || m_report != NULL) {
+        std::lock_guard<std::mutex> lock(g_report_mutex);
+        if (m_report != NULL) {
+            write_report(*m_report, job, this->job(job), result);
+        }
+        if (m_done) {
+            m_done(job, result);
+        }
+    }
+    if (m_batch == NULL) {
+        m_submitted[job] = Job();
+        m_free.push_back(job);
+    }
+}
+
+
+
+std::vector<int> run_jobs(const std::vector<Job>& jobs,
+    const SupervisorOptions& options, const JobDone& done) {
+    if (jobs.empty()) {
+        return std::vector<int>();
+    }
+    return Pool(jobs, options, done).run();
+}
+
+int run_job(const Job& job, const SupervisorOptions& options,
+    JobResult* result) {
+    SupervisorOptions single = options;
+    single.m_parallel = 1;
+    JobDone done;
+    if (result != NULL) {
+        done = [result](size_t, const JobResult& job_result) {
+            *result = job_result;
+        };
+    }
+    return run_jobs(std::vector<Job>(1, job), single, done)[0];
+}
+
+
+
+
+Supervisor::Supervisor(const SupervisorOptions& options, const JobDone& done)
+    : m_done(done),
+      m_pool(new Pool(options, [this](size_t job, const JobResult& result) {
+          finish(job, result);
+      })) {}
+
+Supervisor::~Supervisor() {}
+
+bool Supervisor::open() {
+    return m_pool->open();
+}
+
+EventLoop& Supervisor::loop() {
+    return m_pool->first_worker().loop();
+}
+
+size_t Supervisor::submit(Job job, JobDone done) {
+    size_t index = m_pool->submit(std::move(job));
+    if (done) {
+        m_job_done[index] = std::move(done);
+    }
+    return index;
+}
+
+void Supervisor::finish(size_t job, const JobResult& result) {
+    auto it = m_job_done.find(job);
+    if (it != m_job_done.end()) {
+        JobDone done = std::move(it->second);
+        m_job_done.erase(it);
+        done(job, result);
+    }
+    if (m_done) {
+        m_done(job, result);
+    }
+}
+
+size_t Supervisor::pending() const {
+    return m_pool->submitted();
+}
+
+int Supervisor::run_once() {
+    return m_pool->first_worker().run_once();
+}
+
+} // namespace tuxlike
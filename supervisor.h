@@ -0,0 +1,300 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <signal.h>
+#include <vector>
+
+#include "event_loop.h"
+#include "job.h"
+#include "process_spawn.h"
+#include "tuxliketimeout.h"
+
+namespace tuxlike {
+
+/**
+ * Settings shared by all jobs of one supervisor.
+ */
+struct SupervisorOptions {
+
+    SpawnStrategy m_spawn = SpawnStrategy::PosixSpawn;
+
+    /// How the workers wait for their children and timers.
+    EventEngine m_engine = EventEngine::Epoll;
+
+    /// How many jobs may run at the same time.
+    unsigned m_parallel = 1;
+
+    /// Sent to a job once its time runs out.
+    int m_signal = SIGKILL;
+
+    /// If `m_signal` does not end the job within this many
+    /// nanoseconds, SIGKILL follows. Zero waits forever.
+    uint64_t m_kill_after_ns = 0;
+
+    /// Run every job in a process group of its own and signal
+    /// the whole group when its time runs out.
+    bool m_new_group = true;
+
+    /// If not empty, every job runs in a new cgroup v2 under this
+    /// directory. Its whole tree is killed through `cgroup.kill`, and
+    /// whatever is left in the cgroup when the job exits is killed too.
+    std::string m_cgroup_parent;
+
+    /// If not empty, the stdout and stderr of all jobs are captured
+    /// and written into this file.
+    std::string m_log_path;
+
+    /// If not 0, a job that writes nothing to stdout or stderr for this
+    /// many nanoseconds is treated as if its time ran out.
+    uint64_t m_idle_timeout_ns = 0;
+
+    /// If not 0, a job may use at most this many bytes of memory. In a
+    /// cgroup with the memory controller, this is its `memory.max`
+    /// (without swap) and a job that fails after an OOM kill exits
+    /// with EXIT_OOM. Otherwise, it is the RLIMIT_AS of the child.
+    size_t m_memory_limit = 0;
+
+    /// If not 0, a job that used this many nanoseconds of CPU time is
+    /// treated as if its time ran out, whichever limit comes first.
+    /// In a cgroup, this is the CPU time of the whole tree, which the
+    /// timers of the worker poll from `cpu.stat`. Otherwise, the child
+    /// gets an RLIMIT_CPU of as many seconds, rounded up, and being
+    /// killed by it counts as a timeout.
+    uint64_t m_cpu_timeout_ns = 0;
+
+    /// If not empty, the CPUs every job may run on.
+    std::vector<int> m_cpus;
+
+    /// If not negative, the NUMA node every job runs on: its memory
+    /// is bound to the node and, unless `m_cpus` is given, it runs on
+    /// the CPUs of the node.
+    int m_numa_node = -1;
+
+    /// Deal the jobs round-robin to all NUMA nodes with memory, each
+    /// placed as with `m_numa_node`.
+    bool m_spread_numa = false;
+
+    /// Added to the niceness of every job.
+    int m_nice = 0;
+
+    /// If not negative, the scheduling policy of every job, see
+    /// `parse_sched_policy`.
+    int m_sched_policy = -1;
+
+    /// If not negative, the I/O priority of every job, see
+    /// `parse_io_priority`.
+    int m_io_priority = -1;
+
+    /// Do not pass the output of the jobs on to our stdout and stderr.
+    bool m_quiet = false;
+
+    /// If not 0, keep only this many bytes of the output of a job and
+    /// show them when it fails or times out, instead of passing the
+    /// output on.
+    size_t m_tail_bytes = 0;
+
+    /// Report timings, such as how late the deadlines were
+    /// enforced, on stderr.
+    bool m_verbose = false;
+
+    /// If not empty, the result and `ResourceUsage` of every finished
+    /// job are written into this file as a JSON object per line;
+    /// "-" is stderr.
+    std::string m_report_path;
+};
+
+/**
+ * What a job cost.
+ *
+ * Without a cgroup, this is the rusage of the child, which includes
+ * the descendants it waited for. With a cgroup, the CPU time, memory
+ * and I/O are those of the whole tree of the job, as far as the
+ * controllers of the cgroup account them.
+ */
+struct ResourceUsage {
+
+    uint64_t m_user_ns = 0;
+    uint64_t m_system_ns = 0;
+
+    /// The peak resident set size; of the largest process without a
+    /// cgroup, of the whole cgroup otherwise.
+    uint64_t m_max_rss_bytes = 0;
+
+    /// Bytes read from and written to storage.
+    uint64_t m_read_bytes = 0;
+    uint64_t m_write_bytes = 0;
+
+    uint64_t m_voluntary_switches = 0;
+    uint64_t m_involuntary_switches = 0;
+};
+
+/**
+ * How a job ended.
+ *
+ * Points in time are CLOCK_MONOTONIC nanoseconds, as returned by
+ * `EventLoop::now`, or 0 if they did not happen.
+ */
+struct JobResult {
+
+    /// The exit code of the job, see `run_job`.
+    int m_exit_code = EXIT_CANCELED;
+
+    /// Whether the job ran out of time, or went idle for too long.
+    bool m_timed_out = false;
+
+    /// Whether it took the SIGKILL of `m_kill_after_ns` to end it.
+    bool m_killed = false;
+
+    /// When the spawn started and when it returned.
+    uint64_t m_spawn_start = 0;
+    uint64_t m_spawn_end = 0;
+
+    /// The deadline of the job, if it had one; for a job that went
+    /// idle, the moment its idle timeout ran out.
+    uint64_t m_deadline = 0;
+
+    /// When the job was signalled for running out of time.
+    uint64_t m_signalled = 0;
+
+    /// When the exit of the job was noticed.
+    uint64_t m_reaped = 0;
+
+    /// Zero for a job that did not start.
+    ResourceUsage m_usage;
+};
+
+/**
+ * Called once for every finished job, with its index and result.
+ *
+ * Calls are serialised, but may come from different threads.
+ */
+typedef std::function<void(size_t job, const JobResult& result)> JobDone;
+
+/**
+ * Runs the jobs, at most `options.m_parallel` of them at a time.
+ *
+ * The jobs are dealt to worker threads, one per CPU at most. Each
+ * worker keeps a deque of jobs and supervises several children in
+ * one event loop. Whenever a child exits or times out, its worker
+ * starts the next job from its own deque, or steals one from the
+ * back of the deque of another worker once its own is empty.
+ *
+ * Problems are reported on stderr.
+ *
+ * \return the exit code of every job, see `run_job`.
+ */
+std::vector<int> run_jobs(const std::vector<Job>& jobs,
+    const SupervisorOptions& options, const JobDone& done);
+
+/**
+ * Runs the job and waits until it exits or its time runs out.
+ *
+ * Problems are reported on stderr.
+ *
+ * \param[out] result if not NULL, receives all that is known about
+ *             the finished job.
+ * \return the exit code of the job, 128+SIGNAL if it was killed by
+ *         a signal, or one of the EXIT_* codes of tuxliketimeout.h.
+ *         A job that timed out and needed the SIGKILL of
+ *         `m_kill_after_ns` reports 128+SIGKILL, like GNU timeout.
+ */
+int run_job(const Job& job, const SupervisorOptions& options,
+    JobResult* result = NULL);
+
+class Pool;
+
+/**
+ * Runs jobs as they are submitted, at most `options.m_parallel` of
+ * them at a time, in the event loop of the calling thread.
+ *
+ * Unlike `run_jobs`, which knows all its jobs up front, this is meant
+ * for a long-lived process that receives jobs through descriptors it
+ * watches in the same event loop.
+ */
+class Supervisor {
+public:
+
+    Supervisor(const SupervisorOptions& options, const JobDone& done);
+    ~Supervisor();
+
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+
+    /**
+     * Opens the log and the like, problems are reported on stderr.
+     *
+     * \return false on failure.
+     */
+    bool open();
+
+    /// The event loop that supervises the children.
+    EventLoop& loop();
+
+    /**
+     * Queues the job, it starts with the next `run_once` that finds
+     * a free slot.
+     *
+     * \param[in] job the job.
+     * \param[in] done if set, is called for this job, before the
+     *            `JobDone` of the supervisor.
+     * \return the index `JobDone` is called with. Indexes of finished
+     *         jobs are reused.
+     */
+    size_t submit(Job job, JobDone done = JobDone());
+
+    /// How many jobs are queued or running.
+    size_t pending() const;
+
+    /**
+     * Starts queued jobs while slots are free and dispatches one round
+     * of events, waiting for them as long as it takes. If more jobs
+     * could start right away, it only polls for events.
+     *
+     * \return 0 on success, or the `errno` of the event loop.
+     */
+    int run_once();
+
+private:
+
+    void finish(size_t job, const JobResult& result);
+
+    JobDone m_done;
+
+    /// The `done` of `submit`, by job.
+    std::unordered_map<size_t, JobDone> m_job_done;
+
+    std::unique_ptr<Pool> m_pool;
+};
+
+} // namespace tuxlike
+
+#endif // SUPERVISOR_H
@@ -0,0 +1,209 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "timing_wheel.h"
+
+namespace tuxlike {
+
+static inline uint64_t rotate_right(uint64_t bits, unsigned shift) {
+    shift &= 63;
+    return shift == 0 ? bits : (bits >> shift) | (bits << (64 - shift));
+}
+
+TimingWheel::TimingWheel()
+    : m_now(0), m_due(nullptr) {
+    for (int level = 0; level < LEVELS; level++) {
+        m_occupied[level] = 0;
+        for (unsigned slot = 0; slot < SLOTS; slot++) {
+            m_slots[level][slot] = nullptr;
+        }
+    }
+}
+
+void TimingWheel::arm(Timer& timer, uint64_t deadline) {
+    cancel(timer);
+    timer.m_deadline = deadline;
+    insert(timer);
+}
+
+void TimingWheel::cancel(Timer& timer) {
+    if (timer.armed()) {
+        unlink(timer);
+    }
+}
+
+void TimingWheel::insert(Timer& timer) {
+    uint64_t tick = timer.m_deadline >> TICK_SHIFT;
+    if (tick < m_now) {
+        tick = m_now;
+    }
+
+    // The lowest level whose 64 slots reach the deadline.
+    int level = 0;
+    while (level < LEVELS - 1
+            && (tick >> (level * LEVEL_BITS))
+                - (m_now >> (level * LEVEL_BITS)) >= SLOTS) {
+        level++;
+    }
+    link(timer, level, (tick >> (level * LEVEL_BITS)) & (SLOTS - 1));
+}
+
+void TimingWheel::link(Timer& timer, int level, unsigned slot) {
+    Timer*& head = level == DUE ? m_due : m_slots[level][slot];
+    timer.m_level = level;
+    timer.m_slot = slot;
+    timer.m_prev = nullptr;
+    timer.m_next = head;
+    if (head != nullptr) {
+        head->m_prev = &timer;
+    }
+    head = &timer;
+    if (level != DUE) {
+        m_occupied[level] |= 1ULL << slot;
+    }
+}
+
+void TimingWheel::unlink(Timer& timer) {
+    int level = timer.m_level;
+    Timer*& head = level == DUE ? m_due : m_slots[level][timer.m_slot];
+    if (timer.m_prev != nullptr) {
+        timer.m_prev->m_next = timer.m_next;
+    } else {
+        head = timer.m_next;
+    }
+    if (timer.m_next != nullptr) {
+        timer.m_next->m_prev = timer.m_prev;
+    }
+    if (head == nullptr && level != DUE) {
+        m_occupied[level] &= ~(1ULL << timer.m_slot);
+    }
+    timer.m_prev = nullptr;
+    timer.m_next = nullptr;
+    timer.m_level = -1;
+}
+
+/**
+ * Finds the earliest tick at which a slot needs attention; on a tie
+ * the upper level wins, as its timers may belong to that very tick.
+ */
+bool TimingWheel::next_event(int& level, uint64_t& tick) const {
+    bool found = false;
+    for (int l = LEVELS - 1; l >= 0; l--) {
+        if (m_occupied[l] == 0) {
+            continue;
+        }
+        int shift = l * LEVEL_BITS;
+        uint64_t period = m_now >> shift;
+
+        // Timers are never inserted into the current period of an upper
+        // level, its slot is occupied only while it is being cascaded.
+        uint64_t bits = rotate_right(m_occupied[l], period & (SLOTS - 1));
+        uint64_t when = (period + __builtin_ctzll(bits)) << shift;
+
+        if (!found || when < tick) {
+            found = true;
+            level = l;
+            tick = when;
+        }
+    }
+    return found;
+}
+
+/**
+ * Moves the timers expiring at or before `now` to the due list.
+ */
+void TimingWheel::collect(uint64_t now) {
+    uint64_t target = now >> TICK_SHIFT;
+    int level;
+    uint64_t tick;
+    while (next_event(level, tick) && tick <= target) {
+        m_now = tick;
+        unsigned slot = (tick >> (level * LEVEL_BITS)) & (SLOTS - 1);
+        Timer* timer = m_slots[level][slot];
+
+        if (level > 0) {
+            // Spread the slot over the lower levels.
+            while (timer != nullptr) {
+                Timer* next = timer->m_next;
+                unlink(*timer);
+                insert(*timer);
+                timer = next;
+            }
+            continue;
+        }
+
+        while (timer != nullptr) {
+            Timer* next = timer->m_next;
+            if (timer->m_deadline <= now) {
+                unlink(*timer);
+                link(*timer, DUE, 0);
+            }
+            timer = next;
+        }
+        if (m_slots[level][slot] != nullptr) {
+            // The rest expires later within this very tick.
+            return;
+        }
+    }
+    if (m_now < target) {
+        m_now = target;
+    }
+}
+
+Timer* TimingWheel::pop_expired(uint64_t now) {
+    if (m_due == nullptr) {
+        collect(now);
+    }
+    Timer* timer = m_due;
+    if (timer != nullptr) {
+        unlink(*timer);
+    }
+    return timer;
+}
+
+uint64_t TimingWheel::next_wakeup(uint64_t now) {
+    if (m_due != nullptr) {
+        return now;
+    }
+
+    int level;
+    uint64_t tick;
+    if (!next_event(level, tick)) {
+        return NO_DEADLINE;
+    }
+    if (level > 0 || tick > (now >> TICK_SHIFT)) {
+        return tick << TICK_SHIFT;
+    }
+
+    // Within the current tick, wake up at the exact deadline.
+    uint64_t wakeup = NO_DEADLINE;
+    unsigned slot = tick & (SLOTS - 1);
+    for (Timer* timer = m_slots[0][slot]; timer; timer = timer->m_next) {
+        if (timer->m_deadline < wakeup) {
+            wakeup = timer->m_deadline;
+        }
+    }
+    return wakeup;
+}
+
+} // namespace tuxlike
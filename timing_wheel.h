@@ -0,0 +1,130 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <cstdint>
+#include <functional>
+
+namespace tuxlike {
+
+#define NO_DEADLINE UINT64_MAX
+
+/**
+ * A deadline kept by a `TimingWheel`.
+ *
+ * The timer is embedded in its owner and linked into the wheel,
+ * so arming and cancelling it never allocates.
+ */
+struct Timer {
+
+    /// Called once the deadline passes.
+    std::function<void()> m_callback;
+
+    /// Absolute deadline on CLOCK_MONOTONIC, in nanoseconds.
+    uint64_t m_deadline = NO_DEADLINE;
+
+    bool armed() const { return m_level >= 0; }
+
+private:
+    friend class TimingWheel;
+
+    Timer* m_prev = nullptr;
+    Timer* m_next = nullptr;
+    int m_level = -1;
+    unsigned m_slot = 0;
+};
+
+/**
+ * Hierarchical timing wheel.
+ *
+ * Time is cut into ticks of 2^20 ns (about a millisecond). Level 0
+ * has a slot for each of the next 64 ticks, level 1 for each of the
+ * next 64 spans of 64 ticks, and so on; eight levels cover the whole
+ * 64-bit range. A timer goes to the lowest level that can hold its
+ * deadline and moves one level down whenever the wheel reaches its
+ * slot, so arming and cancelling are O(1). A bitmap of occupied
+ * slots per level finds the next deadline in O(levels), no matter
+ * how long the wheel stays idle.
+ *
+ * Timers expire at their exact deadline, not at the tick: the
+ * entries of the current tick are compared one by one.
+ */
+class TimingWheel {
+public:
+
+    TimingWheel();
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /// (Re)arms the timer for the absolute `deadline` in nanoseconds.
+    void arm(Timer& timer, uint64_t deadline);
+
+    /// Disarms the timer, if armed.
+    void cancel(Timer& timer);
+
+    /**
+     * When the owner should wake up next, in nanoseconds.
+     *
+     * This is either an expiry or the moment when a slot of an upper
+     * level is due to be spread over the lower levels.
+     *
+     * \return NO_DEADLINE if no timer is armed.
+     */
+    uint64_t next_wakeup(uint64_t now);
+
+    /**
+     * Disarms and returns one timer whose deadline is not after
+     * `now`, or nullptr if there is none.
+     */
+    Timer* pop_expired(uint64_t now);
+
+private:
+
+    static const int TICK_SHIFT = 20;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 8;
+    static const unsigned SLOTS = 1u << LEVEL_BITS;
+
+    /// Pseudo-level of timers that already expired.
+    static const int DUE = LEVELS;
+
+    void insert(Timer& timer);
+    void link(Timer& timer, int level, unsigned slot);
+    void unlink(Timer& timer);
+    bool next_event(int& level, uint64_t& tick) const;
+    void collect(uint64_t now);
+
+    /// The current tick; every armed timer expires at or after it.
+    uint64_t m_now;
+
+    Timer* m_slots[LEVELS][SLOTS];
+    uint64_t m_occupied[LEVELS];
+    Timer* m_due;
+};
+
+} // namespace tuxlike
+
+#endif // TIMING_WHEEL_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "tuxlike.h"
+
+namespace tuxlike {
+
+Result run_with_timeout(const Job& job, const SupervisorOptions& options) {
+    Result result;
+    run_job(job, options, &result);
+    return result;
+}
+
+Result run_with_timeout(const std::vector<std::string>& argv,
+    std::chrono::nanoseconds timeout, const SupervisorOptions& options) {
+
+    Job job;
+    job.m_argv = argv;
+    job.m_timeout_ns = duration_ns(timeout);
+    return run_with_timeout(job, options);
+}
+
+Result run_with_timeout(const std::vector<std::string>& argv,
+    std::chrono::steady_clock::time_point deadline,
+    const SupervisorOptions& options) {
+
+    Job job;
+    job.m_argv = argv;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+        // steady_clock is CLOCK_MONOTONIC, like the deadlines of the jobs.
+        job.m_deadline_ns = duration_ns(deadline.time_since_epoch());
+    }
+    return run_with_timeout(job, options);
+}
+
+std::future<Result> run_with_timeout_async(Job job,
+    const SupervisorOptions& options) {
+
+    return std::async(std::launch::async, [job, options]() {
+        return run_with_timeout(job, options);
+    });
+}
+
+std::future<Result> run_with_timeout_async(
+    const std::vector<std::string>& argv, std::chrono::nanoseconds timeout,
+    const SupervisorOptions& options) {
+
+    Job job;
+    job.m_argv = argv;
+    job.m_timeout_ns = duration_ns(timeout);
+    return run_with_timeout_async(std::move(job), options);
+}
+
+} // namespace tuxlike
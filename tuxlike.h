@@ -0,0 +1,81 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef TUXLIKE_H
+#define TUXLIKE_H
+
+// The public interface of libtuxlike, which runs programs with a
+// deadline from within another process. tuxliketimeout is a thin
+// command line wrapper around it.
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "awaitable.h"
+#include "job.h"
+#include "supervisor.h"
+
+namespace tuxlike {
+
+typedef JobResult Result;
+
+/**
+ * Runs the job and waits until it exits or its time runs out, see
+ * `run_job`. Problems are reported on stderr.
+ */
+Result run_with_timeout(const Job& job,
+    const SupervisorOptions& options = SupervisorOptions());
+
+/**
+ * Runs `argv[0]` (searched in `PATH`) and waits until it exits or
+ * `timeout` runs out; `std::chrono::nanoseconds::max()` never does.
+ */
+Result run_with_timeout(const std::vector<std::string>& argv,
+    std::chrono::nanoseconds timeout,
+    const SupervisorOptions& options = SupervisorOptions());
+
+/**
+ * Runs `argv[0]` (searched in `PATH`) and waits until it exits or
+ * `deadline` passes, however long the spawn takes; a deadline in the
+ * past times the job out at once. `time_point::max()` never passes.
+ */
+Result run_with_timeout(const std::vector<std::string>& argv,
+    std::chrono::steady_clock::time_point deadline,
+    const SupervisorOptions& options = SupervisorOptions());
+
+/**
+ * Like `run_with_timeout`, but returns at once; the job is supervised
+ * by a thread of its own.
+ */
+std::future<Result> run_with_timeout_async(Job job,
+    const SupervisorOptions& options = SupervisorOptions());
+
+std::future<Result> run_with_timeout_async(
+    const std::vector<std::string>& argv, std::chrono::nanoseconds timeout,
+    const SupervisorOptions& options = SupervisorOptions());
+
+} // namespace tuxlike
+
+#endif // TUXLIKE_H
@@ -0,0 +1,291 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "bench.h"
+#include "cmdline.h"
+#include "job.h"
+
+using namespace tuxlike;
+
+/**
+ * Arguments of any character type, as `encode_command_line` takes
+ * them.
+ */
+template<typename Char>
+struct Arguments {
+
+    std::vector<std::basic_string<Char>> m_strings;
+    std::vector<const Char*> m_pointers;
+
+    void add(std::basic_string<Char> argument) {
+        m_strings.push_back(std::move(argument));
+    }
+
+    std::span<const Char* const> span() {
+        m_pointers.clear();
+        for (const auto& argument : m_strings) {
+            m_pointers.push_back(argument.c_str());
+        }
+        return m_pointers;
+    }
+
+    /// How many characters the arguments have together.
+    size_t length() const {
+        size_t length = 0;
+        for (const auto& argument : m_strings) {
+            length += argument.size();
+        }
+        return length;
+    }
+};
+
+/**
+ * Arguments of one kind, as the programs tuxliketimeout wraps
+ * tend to get them.
+ */
+struct Corpus {
+    const char* m_name;
+    std::vector<const wchar_t*> m_arguments;
+};
+
+static const Corpus CORPORA[] = {
+    { "short_flags", {
+        L"-v", L"-j8", L"--jobs=8", L"-o", L"out.obj", L"/nologo",
+        L"/W4", L"/EHsc", L"-DNDEBUG", L"--", L"-x", L"c++", L"/O2",
+        L"--color=never", L"-q", L"/MP",
+    } },
+    { "long_paths", {
+        L"C:\\Program Files (x86)\\Microsoft Visual Studio\\2019\\"
+            L"BuildTools\\VC\\Tools\\MSVC\\14.29.30133\\bin\\Hostx64\\x64\\cl.exe",
+        L"/IC:\\Users\\build\\source\\repos\\project\\third_party\\"
+            L"include",
+        L"\\\\fileserver\\builds\\nightly\\2024-05-01\\artifacts\\"
+            L"windows-x64\\release\\bin",
+        L"C:\\Users\\build\\AppData\\Local\\Temp\\cl_7f3a9c\\"
+            L"precompiled_header.pch",
+        L"D:\\a\\_work\\1\\s\\src\\components\\renderer\\backend\\"
+            L"d3d12\\command_queue.cpp",
+    } },
+    { "quotes", {
+        L"NAME=\"quoted value\"",
+        L"--message=\"release \"candidate\" 2\"",
+        L"{\"key\": \"value\", \"list\": [\"a\", \"b\"]}",
+        L"\"",
+        L"say \"hello\" to \"everyone\"",
+        L"/DVERSION=\"1.2.3\"",
+    } },
+    { "backslashes", {
+        L"C:\\src\\project with spaces\\",
+        L"\\\\server\\share\\dir\\",
+        L"trailing\\\\\\",
+        L"before quote\\\\\\\"after",
+        L"\\d+\\s*\\w+\\\\",
+        L"C:\\a\\b\\c\\d\\e\\f\\g\\h\\",
+    } },
+};
+
+/// `corpus`, converted from wide characters to `Char`.
+template<typename Char>
+static Arguments<Char> corpus_arguments(const Corpus& corpus) {
+    Arguments<Char> arguments;
+    for (const wchar_t* argument : corpus.m_arguments) {
+        std::wstring wide(argument);
+        arguments.add(std::basic_string<Char>(wide.begin(), wide.end()));
+    }
+    return arguments;
+}
+
+/// A command line with arguments of every kind, led by a program.
+static Arguments<wchar_t> mixed_arguments() {
+    Arguments<wchar_t> mixed;
+    mixed.add(L"C:\\Program Files\\Vendor\\Tool\\bin\\tool.exe");
+    for (const Corpus& corpus : CORPORA) {
+        for (size_t i = 0; i < corpus.m_arguments.size(); i += 2) {
+            mixed.add(corpus.m_arguments[i]);
+        }
+    }
+    return mixed;
+}
+
+
+
+/**
+ * What wmain did before `encode_command_line`: a copy of every
+ * argument, appended to a command line that grows as it goes.
+ */
+static std::wstring per_argument(std::span<const wchar_t* const> arguments) {
+    std::wstring command_line;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (i > 0) {
+            command_line += L" ";
+        }
+        std::wstring copy(arguments[i]);
+        quote_argument(std::wstring_view(copy), command_line, false);
+    }
+    return command_line;
+}
+
+/// Quoting and decoding of every corpus, as `Char`.
+template<typename Char>
+static void bench_corpora(Bench& bench, const char* type) {
+    for (const Corpus& corpus : CORPORA) {
+        Arguments<Char> arguments = corpus_arguments<Char>(corpus);
+        std::string suffix = std::string(corpus.m_name) + "/" + type;
+
+        std::basic_string<Char> quoted;
+        bench.measure("quote_argument/" + suffix, "chars", [&]() {
+            quoted.clear();
+            for (const auto& argument : arguments.m_strings) {
+                quote_argument(std::basic_string_view<Char>(argument),
+                    quoted, false);
+            }
+            return arguments.length();
+        });
+
+        std::basic_string<Char> command_line =
+            encode_command_line(arguments.span());
+        bench.measure("decode_command_line/" + suffix, "chars", [&]() {
+            std::vector<std::basic_string<Char>> decoded =
+                decode_command_line(
+                    std::basic_string_view<Char>(command_line));
+            return decoded.empty() ? 0 : command_line.size();
+        });
+    }
+}
+
+/// The TIMEOUT argument, in the forms it comes in.
+static void bench_timeouts(Bench& bench) {
+    static const char* const TIMEOUTS[] = {
+        "1500", "1.5s", "250us", "0.000001s", "4294967295", "bogus",
+    };
+    for (const char* timeout : TIMEOUTS) {
+        std::string text(timeout);
+        bench.measure(std::string("parse_duration/") + timeout, "parses",
+            [&]() {
+                uint64_t ns = 0;
+                return parse_duration(text, ns) ? 1 : 0;
+            });
+    }
+
+    // How the Windows build parses it.
+    std::wstring wide(L"1500");
+    bench.measure("stoul/1500", "parses", [&]() {
+        return std::stoul(wide) == 1500 ? 1 : 0;
+    });
+}
+
+/// Building the command line of CreateProcessW from argv.
+static void bench_command_lines(Bench& bench) {
+    Arguments<wchar_t> mixed = mixed_arguments();
+    std::span<const wchar_t* const> span = mixed.span();
+    size_t length = mixed.length();
+
+    bench.measure("command_line/per_argument", "chars", [&]() {
+        return per_argument(span).empty() ? 0 : length;
+    });
+    bench.measure("command_line/encode", "chars", [&]() {
+        return encode_command_line(span).empty() ? 0 : length;
+    });
+    std::wstring reused;
+    bench.measure("command_line/encode_reused", "chars", [&]() {
+        encode_command_line(span, reused);
+        return length;
+    });
+}
+
+
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [OPTION]..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  --json=FILE       write the results as JSON into FILE ('-' is stdout)" << std::endl;
+    std::cerr << "  --filter=TEXT     only run benchmarks whose name contains TEXT" << std::endl;
+    std::cerr << "  --min-time=DURATION  run every repetition this long (default 100ms)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        { "json",     required_argument, NULL, 'j' },
+        { "filter",   required_argument, NULL, 'f' },
+        { "min-time", required_argument, NULL, 't' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    std::string json_path;
+    std::string filter;
+    uint64_t min_ns = 100000000ULL;
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'j':
+                json_path = optarg;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 't':
+                if (!parse_duration(optarg, min_ns) || min_ns == 0) {
+                    std::cerr << "Invalid --min-time: " << optarg << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The table goes to stderr when stdout takes the JSON.
+    Bench bench(min_ns, filter, json_path == "-" ? std::cerr : std::cout);
+    bench_corpora<char>(bench, "char");
+    bench_corpora<char16_t>(bench, "char16_t");
+    bench_corpora<wchar_t>(bench, "wchar_t");
+    bench_timeouts(bench);
+    bench_command_lines(bench);
+
+    if (json_path == "-") {
+        bench.write_json(std::cout);
+    } else if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        bench.write_json(json);
+        json.close();
+        if (!json) {
+            std::cerr << "Cannot write " << json_path << "." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,372 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "cgroup.h"
+#include "tuxlike.h"
+
+using namespace tuxlike;
+
+/// Runs before the measured ones, to warm up caches and the like.
+#define WARMUP_RUNS 20
+
+
+
+/**
+ * The child of the benchmark, started as `tuxlike_latency --stamp
+ * FILE`: writes the CLOCK_MONOTONIC time it started at into FILE.
+ */
+static int stamp(const char* path) {
+    uint64_t now = EventLoop::now();
+    int fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (fd < 0 || write(fd, &now, sizeof(now)) != sizeof(now)) {
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * The child of the benchmark, started as `tuxlike_latency --sleep`:
+ * waits to be killed.
+ */
+static int sleep_forever() {
+    for (;;) {
+        pause();
+    }
+}
+
+/**
+ * Reads what a `stamp` child wrote.
+ *
+ * \return 0 if the file holds no time.
+ */
+static uint64_t read_stamp(int fd) {
+    uint64_t stamp;
+    if (pread(fd, &stamp, sizeof(stamp), 0) != sizeof(stamp)) {
+        return 0;
+    }
+    return stamp;
+}
+
+/// `to - from`, or 0 if `to` came first or did not happen.
+static uint64_t elapsed(uint64_t from, uint64_t to) {
+    return to > from ? to - from : 0;
+}
+
+
+
+/**
+ * The latencies of the wrapper, measured around `run_with_timeout`,
+ * which is what tuxliketimeout does with its one job.
+ */
+struct Measurements {
+
+    /// How long the spawn call took in the supervisor.
+    Latencies m_spawn_call{"spawn_call"};
+
+    /// From the start of the spawn to the main of the child.
+    Latencies m_spawn_to_exec{"spawn_to_exec"};
+
+    /// From the child, which exits right after it started, to the
+    /// supervisor noticing its exit, and to it returning.
+    Latencies m_exit_to_reaped{"exit_to_reaped"};
+    Latencies m_exit_to_return{"exit_to_return"};
+
+    /// The whole `run_with_timeout` of `true`.
+    Latencies m_true_round_trip{"true_round_trip"};
+
+    /// From the deadline to the signal; for a timer that fires late,
+    /// this is how late.
+    Latencies m_deadline_to_signal{"deadline_to_signal"};
+
+    /// From the deadline to `run_with_timeout` returning: by how much
+    /// the wrapper overshoots the TIMEOUT.
+    Latencies m_deadline_overshoot{"deadline_overshoot"};
+
+    /// From the signal to the supervisor noticing the exit.
+    Latencies m_signal_to_reaped{"signal_to_reaped"};
+
+    std::vector<Latencies*> all() {
+        return {
+            &m_spawn_call, &m_spawn_to_exec, &m_exit_to_reaped,
+            &m_exit_to_return, &m_true_round_trip, &m_deadline_to_signal,
+            &m_deadline_overshoot, &m_signal_to_reaped,
+        };
+    }
+};
+
+/**
+ * Runs `job` and checks how it ended.
+ *
+ * \param[out] returned when `run_with_timeout` returned.
+ * \return false, after reporting why, if it did not end as expected.
+ */
+static bool run(const Job& job, const SupervisorOptions& options,
+    bool timeout_expected, Result& result, uint64_t& returned)
+{
+    result = run_with_timeout(job, options);
+    returned = EventLoop::now();
+    if (result.m_timed_out != timeout_expected
+            || (!timeout_expected && result.m_exit_code != 0)) {
+        std::cerr << "'" << job.m_argv[0] << "' exited with ";
+        std::cerr << result.m_exit_code << (result.m_timed_out
+            ? " after it timed out." : ".") << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Measures `runs` runs of each kind: a child that stamps the time it
+ * started, `true`, and a child that sleeps until its timeout.
+ *
+ * \return false if a run went wrong.
+ */
+static bool measure(const std::string& self, const SupervisorOptions& options,
+    uint64_t timeout_ns, unsigned runs, Measurements& measurements)
+{
+    char stamp_path[PATH_MAX];
+    const char* tmpdir = getenv("TMPDIR");
+    snprintf(stamp_path, sizeof(stamp_path), "%s/tuxlike_latency.XXXXXX",
+        tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp");
+    int stamp_fd = mkstemp(stamp_path);
+    if (stamp_fd < 0) {
+        std::cerr << "mkstemp failed. (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    Job stamp_job;
+    stamp_job.m_argv = { self, "--stamp", stamp_path };
+    stamp_job.m_timeout_ns = 10 * 1000000000ULL;
+    Job true_job;
+    true_job.m_argv = { "true" };
+    true_job.m_timeout_ns = 10 * 1000000000ULL;
+    Job sleep_job;
+    sleep_job.m_argv = { self, "--sleep" };
+    sleep_job.m_timeout_ns = timeout_ns;
+
+    bool ok = true;
+    Result result;
+    uint64_t returned;
+    for (unsigned i = 0; ok && i < WARMUP_RUNS + runs; i++) {
+        bool warm = i >= WARMUP_RUNS;
+
+        ok = run(stamp_job, options, false, result, returned);
+        uint64_t started = read_stamp(stamp_fd);
+        if (ok && started == 0) {
+            std::cerr << "The child did not stamp its start." << std::endl;
+            ok = false;
+        }
+        if (ok && warm) {
+            measurements.m_spawn_call.add(
+                elapsed(result.m_spawn_start, result.m_spawn_end));
+            measurements.m_spawn_to_exec.add(
+                elapsed(result.m_spawn_start, started));
+            measurements.m_exit_to_reaped.add(
+                elapsed(started, result.m_reaped));
+            measurements.m_exit_to_return.add(elapsed(started, returned));
+        }
+
+        uint64_t called = EventLoop::now();
+        ok = ok && run(true_job, options, false, result, returned);
+        if (ok && warm) {
+            measurements.m_true_round_trip.add(elapsed(called, returned));
+        }
+
+        ok = ok && run(sleep_job, options, true, result, returned);
+        if (ok && warm) {
+            measurements.m_deadline_to_signal.add(
+                elapsed(result.m_deadline, result.m_signalled));
+            measurements.m_deadline_overshoot.add(
+                elapsed(result.m_deadline, returned));
+            measurements.m_signal_to_reaped.add(
+                elapsed(result.m_signalled, result.m_reaped));
+        }
+    }
+    close(stamp_fd);
+    unlink(stamp_path);
+    return ok;
+}
+
+static void write_json(std::ostream& out, const SupervisorOptions& options,
+    uint64_t timeout_ns, Measurements& measurements)
+{
+    out << "{\n";
+    write_json_context(out);
+    out << "  \"options\": {\n";
+    out << "    \"spawn\": \"" << spawn_strategy_name(options.m_spawn) << "\",\n";
+    out << "    \"event_engine\": \"" << event_engine_name(options.m_engine) << "\",\n";
+    out << "    \"cgroup\": " << (options.m_cgroup_parent.empty()
+        ? "false" : "true") << ",\n";
+    out << "    \"timeout_ns\": " << timeout_ns << "\n";
+    out << "  },\n";
+    out << "  \"latencies\": [";
+    const char* separator = "\n";
+    for (Latencies* latencies : measurements.all()) {
+        out << separator;
+        latencies->write_json(out);
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [OPTION]..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  --runs=N          measure N runs of every kind (default 2000)" << std::endl;
+    std::cerr << "  --timeout=DURATION  the TIMEOUT of the child that sleeps (default 1ms)" << std::endl;
+    std::cerr << "  --spawn=STRATEGY  posix_spawn, vfork or fork" << std::endl;
+    std::cerr << "  --event-engine=ENGINE  epoll (default), io_uring or auto" << std::endl;
+    std::cerr << "  --cgroup[=PARENT] run every child in a new cgroup v2 under PARENT" << std::endl;
+    std::cerr << "  --json=FILE       write the results as JSON into FILE ('-' is stdout)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--stamp") == 0) {
+        return stamp(argv[2]);
+    }
+    if (argc == 2 && strcmp(argv[1], "--sleep") == 0) {
+        return sleep_forever();
+    }
+
+    static const struct option long_options[] = {
+        { "cgroup",  optional_argument, NULL, 'c' },
+        { "event-engine", required_argument, NULL, 'E' },
+        { "json",    required_argument, NULL, 'j' },
+        { "runs",    required_argument, NULL, 'r' },
+        { "spawn",   required_argument, NULL, 'P' },
+        { "timeout", required_argument, NULL, 't' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    SupervisorOptions options;
+    options.m_quiet = true;
+    uint64_t timeout_ns = 1000000ULL;
+    unsigned long runs = 2000;
+    std::string json_path;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c':
+                if (optarg != NULL) {
+                    options.m_cgroup_parent = optarg;
+                } else if (!own_cgroup(options.m_cgroup_parent)) {
+                    std::cerr << "No cgroup v2 hierarchy found." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'E':
+                if (!parse_event_engine(optarg, options.m_engine)) {
+                    std::cerr << "Unknown event engine '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                json_path = optarg;
+                break;
+            case 'r': {
+                char* end;
+                errno = 0;
+                runs = strtoul(optarg, &end, 10);
+                if (errno != 0 || *end != '\0' || runs == 0 || runs > UINT_MAX) {
+                    std::cerr << "The number of runs must be a positive";
+                    std::cerr << " number." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'P':
+                if (!parse_spawn_strategy(optarg, options.m_spawn)) {
+                    std::cerr << "Unknown spawn strategy '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (!parse_duration(optarg, timeout_ns)
+                        || timeout_ns == DURATION_INFINITE) {
+                    std::cerr << "The DURATION of --timeout must be";
+                    std::cerr << " such as 1500, 1.5s or 250us." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char self[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length < 0) {
+        std::cerr << "readlink failed. (" << strerror(errno) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    self[length] = '\0';
+
+    Measurements measurements;
+    if (!measure(self, options, timeout_ns, runs, measurements)) {
+        return EXIT_FAILURE;
+    }
+
+    // The table goes to stderr when stdout takes the JSON.
+    std::ostream& table = json_path == "-" ? std::cerr : std::cout;
+    for (Latencies* latencies : measurements.all()) {
+        latencies->write_table(table);
+        table << std::endl;
+    }
+
+    if (json_path == "-") {
+        write_json(std::cout, options, timeout_ns, measurements);
+    } else if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        write_json(json, options, timeout_ns, measurements);
+        json.close();
+        if (!json) {
+            std::cerr << "Cannot write " << json_path << "." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -27,71 +27,10 @@
 #include <windows.h>
 #include <IntSafe.h>
 
-#define EXIT_TIMEDOUT      (124) // job timed out
-#define EXIT_CANCELED      (125) // internal error
-#define EXIT_CANNOT_INVOKE (126) // error executing job
-#define EXIT_ENOENT        (127) // couldn't find job to exec
-
-/**
- * This routine appends the given argument to a command line such
- * that CommandLineToArgvW will return the argument string unchanged.
- * Arguments in a command line should be separated by spaces;
- * this function does not add these spaces.
- *
- * Source:
- * https://blogs.msdn.microsoft.com/twistylittlepassagesallalike/2011/04/23/everyone-quotes-command-line-arguments-the-wrong-way/
- * 
- * \param[in] Argument supplies the argument to encode.
- * \param[out] CommandLine supplies the command line to which
- *             we append the encoded argument string.
- * \param[in] Force supplies an indication of whether we should quote
- *            the argument even if it does not contain any characters
- *            that would ordinarily require quoting.
- */
-void ArgvQuote (const std::wstring& Argument,
-    std::wstring& CommandLine, bool Force)
-{
-    // Unless we're told otherwise, don't quote unless we actually
-    // need to do so --- hopefully avoid problems if programs won't
-    // parse quotes properly
-    if (Force == false
-            && Argument.empty() == false
-            && Argument.find_first_of(L" \t\n\v\"") == Argument.npos) {
-        CommandLine.append(Argument);
-    } else {
-        CommandLine.push_back(L'"');
-        
-        for (auto It = Argument.begin(); ; ++It) {
-            unsigned NumberBackslashes = 0;
-        
-            while (It != Argument.end() && *It == L'\\') {
-                ++It;
-                ++NumberBackslashes;
-            }
-        
-            if (It == Argument.end()) {
-                // Escape all backslashes, but let the terminating
-                // double quotation mark we add below be interpreted
-                // as a metacharacter.
-                CommandLine.append(NumberBackslashes * 2, L'\\');
-                break;
-            } else if (*It == L'"') {
-                // Escape all backslashes and the following
-                // double quotation mark.
-                CommandLine.append(NumberBackslashes * 2 + 1, L'\\');
-                CommandLine.push_back(*It);
-            } else {
-                // Backslashes aren't special here.
-                CommandLine.append(NumberBackslashes, L'\\');
-                CommandLine.push_back(*It);
-            }
-        }
-    
-        CommandLine.push_back(L'"');
-    }
-}
-
+#include "cmdline.h"
+#include "tuxliketimeout.h"
 
+using tuxlike::encode_command_line;
 
 /**
  * Calls a clean-up method in the destructor.
@@ -140,13 +79,8 @@ int wmain(int argc, wchar_t *argv[], wchar_t *envp[]) {
         return EXIT_CANCELED;
     }
 
-    std::wstring command_line;
-    for (int argi = 2; argi < argc; argi++) {
-        ArgvQuote(std::wstring(argv[argi]), command_line, false);
-        if (argi < argc) {
-            command_line += L" ";
-        }
-    }
+    std::wstring command_line = encode_command_line(
+        std::span<const wchar_t* const>(argv + 2, argc - 2));
 
     // Do not use/modify/... command_line after this line:
     LPWSTR command_line_buf = const_cast<wchar_t*>(command_line.c_str());
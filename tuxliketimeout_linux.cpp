@@ -0,0 +1,455 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "daemon.h"
+#include "placement.h"
+#include "tuxlike.h"
+#include "tuxliketimeout.h"
+
+using namespace tuxlike;
+
+extern char** environ;
+
+
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0;
+    std::cerr << " [OPTION]... TIMEOUT PROGRAM [ARGUMENTS...]" << std::endl;
+    std::cerr << "   or: " << argv0;
+    std::cerr << " [OPTION]... --batch=MANIFEST" << std::endl;
+    std::cerr << "   or: " << argv0;
+    std::cerr << " [OPTION]... --daemon=SOCKET" << std::endl;
+    std::cerr << "   or: " << argv0;
+    std::cerr << " --submit=SOCKET TIMEOUT PROGRAM [ARGUMENTS...]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  --batch=MANIFEST  run the jobs listed in MANIFEST ('-' is stdin)" << std::endl;
+    std::cerr << "  -0, --null        MANIFEST fields are NUL-terminated" << std::endl;
+    std::cerr << "  --cgroup[=PARENT] run every job in a new cgroup v2 under PARENT" << std::endl;
+    std::cerr << "                    (our own cgroup by default)" << std::endl;
+    std::cerr << "  --cpu-timeout=DURATION" << std::endl;
+    std::cerr << "                    also time out once the job used DURATION" << std::endl;
+    std::cerr << "                    of CPU time" << std::endl;
+    std::cerr << "  --cpus=LIST       run the jobs on the CPUs in LIST, such as 0-3,8" << std::endl;
+    std::cerr << "  --daemon=SOCKET   run the jobs submitted through SOCKET until" << std::endl;
+    std::cerr << "                    SIGINT or SIGTERM" << std::endl;
+    std::cerr << "  --event-engine=ENGINE" << std::endl;
+    std::cerr << "                    epoll (default), io_uring (Linux 5.13 or" << std::endl;
+    std::cerr << "                    later) or auto: io_uring where supported" << std::endl;
+    std::cerr << "  --foreground      do not put the job into a process group of" << std::endl;
+    std::cerr << "                    its own; only the job itself is signalled" << std::endl;
+    std::cerr << "  --idle-timeout=DURATION" << std::endl;
+    std::cerr << "                    also time out when the job writes nothing" << std::endl;
+    std::cerr << "                    to stdout or stderr for DURATION" << std::endl;
+    std::cerr << "  --ionice=CLASS[:LEVEL]" << std::endl;
+    std::cerr << "                    I/O priority of the jobs: realtime, best-effort" << std::endl;
+    std::cerr << "                    or idle, LEVEL 0 (highest) to 7" << std::endl;
+    std::cerr << "  -j, --jobs=N      run up to N jobs of MANIFEST at a time" << std::endl;
+    std::cerr << "  -k, --kill-after=DURATION" << std::endl;
+    std::cerr << "                    send KILL if the job still runs DURATION" << std::endl;
+    std::cerr << "                    after the signal was sent" << std::endl;
+    std::cerr << "  --log=FILE        also write the output of the jobs into FILE" << std::endl;
+    std::cerr << "  --memory-limit=BYTES" << std::endl;
+    std::cerr << "                    let every job use at most BYTES of memory;" << std::endl;
+    std::cerr << "                    exit with 123 if it fails after an OOM kill" << std::endl;
+    std::cerr << "  --nice=N          add N to the niceness of the jobs" << std::endl;
+    std::cerr << "  --numa-node=N     bind the memory of the jobs to NUMA node N and" << std::endl;
+    std::cerr << "                    run them on its CPUs" << std::endl;
+    std::cerr << "  -q, --quiet       do not show the output of the jobs" << std::endl;
+    std::cerr << "  --tail=BYTES      keep the last BYTES of output, show them on failure" << std::endl;
+    std::cerr << "  --report=FILE     write the exit code, CPU time, peak memory and" << std::endl;
+    std::cerr << "                    I/O of every job to FILE as JSON, a line per" << std::endl;
+    std::cerr << "                    job ('-' is stderr)" << std::endl;
+    std::cerr << "  --results=FILE    write 'JOB EXITCODE' lines to FILE, not stderr" << std::endl;
+    std::cerr << "  --sched=POLICY    scheduling policy of the jobs: other, batch" << std::endl;
+    std::cerr << "                    or idle" << std::endl;
+    std::cerr << "  -s, --signal=SIG  signal sent on timeout; KILL by default," << std::endl;
+    std::cerr << "                    TERM if --kill-after is given" << std::endl;
+    std::cerr << "  --spawn=STRATEGY  posix_spawn (default), vfork or fork" << std::endl;
+    std::cerr << "  --spread-numa     deal the jobs round-robin to the NUMA nodes" << std::endl;
+    std::cerr << "  --submit=SOCKET   run the job in the daemon at SOCKET" << std::endl;
+    std::cerr << "  -v, --verbose     report timings on stderr" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "TIMEOUT and DURATION are milliseconds, unless they end with" << std::endl;
+    std::cerr << "one of the units ns, us, ms, s, m or h; 1.5s is fine too." << std::endl;
+}
+
+
+
+static bool parse_int(const char* text, int& number) {
+    char* end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0'
+            || value < INT_MIN || value > INT_MAX) {
+        return false;
+    }
+    number = (int) value;
+    return true;
+}
+
+static bool parse_parallel(const char* text, unsigned& parallel) {
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || text[0] == '-'
+            || value == 0 || value > UINT_MAX) {
+        return false;
+    }
+    parallel = (unsigned) value;
+    return true;
+}
+
+
+
+/**
+ * Reads the whole manifest, `-` stands for the standard input.
+ */
+static bool read_file(const char* path, std::string& content) {
+    std::ostringstream buffer;
+    if (strcmp(path, "-") == 0) {
+        buffer << std::cin.rdbuf();
+    } else {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        buffer << file.rdbuf();
+    }
+    content = buffer.str();
+    return true;
+}
+
+
+
+/**
+ * Runs all jobs of the manifest.
+ *
+ * \return 0 if all jobs succeeded, otherwise the exit code of
+ *         the first job (in manifest order) that did not.
+ */
+static int run_batch(const std::vector<Job>& jobs,
+    const SupervisorOptions& options, std::ostream& results) {
+
+    std::vector<int> exit_codes = run_jobs(jobs, options,
+        [&results](size_t job, const JobResult& result) {
+            results << (job + 1) << " " << result.m_exit_code << std::endl;
+        });
+
+    for (int exit_code : exit_codes) {
+        if (exit_code != 0) {
+            return exit_code;
+        }
+    }
+    return 0;
+}
+
+
+
+int main(int argc, char *argv[]) {
+
+    static const struct option long_options[] = {
+        { "batch",   required_argument, NULL, 'b' },
+        { "cgroup",  optional_argument, NULL, 'c' },
+        { "cpu-timeout", required_argument, NULL, 'C' },
+        { "cpus",    required_argument, NULL, 'A' },
+        { "daemon",  required_argument, NULL, 'D' },
+        { "event-engine", required_argument, NULL, 'E' },
+        { "foreground", no_argument,    NULL, 'f' },
+        { "ionice",  required_argument, NULL, 'I' },
+        { "jobs",    required_argument, NULL, 'j' },
+        { "idle-timeout", required_argument, NULL, 'i' },
+        { "kill-after", required_argument, NULL, 'k' },
+        { "log",     required_argument, NULL, 'l' },
+        { "memory-limit", required_argument, NULL, 'M' },
+        { "nice",    required_argument, NULL, 'n' },
+        { "numa-node", required_argument, NULL, 'N' },
+        { "quiet",   no_argument,       NULL, 'q' },
+        { "tail",    required_argument, NULL, 't' },
+        { "null",    no_argument,       NULL, '0' },
+        { "report",  required_argument, NULL, 'R' },
+        { "results", required_argument, NULL, 'r' },
+        { "sched",   required_argument, NULL, 'x' },
+        { "signal",  required_argument, NULL, 's' },
+        { "spawn",   required_argument, NULL, 'P' },
+        { "spread-numa", no_argument,   NULL, 'W' },
+        { "submit",  required_argument, NULL, 'S' },
+        { "verbose", no_argument,       NULL, 'v' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    SupervisorOptions options;
+    const char* manifest_path = NULL;
+    const char* daemon_path = NULL;
+    const char* submit_path = NULL;
+    const char* results_path = NULL;
+    char delimiter = '\n';
+    bool signal_given = false;
+
+    // The leading '+' stops at PROGRAM, its options are not ours.
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+0j:k:qs:v", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                manifest_path = optarg;
+                break;
+            case 'c':
+                if (optarg != NULL) {
+                    options.m_cgroup_parent = optarg;
+                } else if (!own_cgroup(options.m_cgroup_parent)) {
+                    std::cerr << "No cgroup v2 hierarchy found." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'f':
+                options.m_new_group = false;
+                break;
+            case 'j':
+                if (!parse_parallel(optarg, options.m_parallel)) {
+                    std::cerr << "The number of jobs must be a positive";
+                    std::cerr << " number." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case '0':
+                delimiter = '\0';
+                break;
+            case 'r':
+                results_path = optarg;
+                break;
+            case 'R':
+                options.m_report_path = optarg;
+                break;
+            case 'k':
+                if (!parse_duration(optarg, options.m_kill_after_ns)) {
+                    std::cerr << "The DURATION of --kill-after must be";
+                    std::cerr << " such as 1500, 1.5s or 250us." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'A':
+                if (!parse_cpu_list(optarg, options.m_cpus)) {
+                    std::cerr << "The LIST of --cpus must be such as";
+                    std::cerr << " 0-3,8." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'I':
+                if (!parse_io_priority(optarg, options.m_io_priority)) {
+                    std::cerr << "Unknown I/O priority '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'n':
+                if (!parse_int(optarg, options.m_nice)) {
+                    std::cerr << "The N of --nice must be a number.";
+                    std::cerr << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'N':
+                if (!parse_int(optarg, options.m_numa_node)
+                        || options.m_numa_node < 0
+                        || options.m_numa_node >= NUMA_MAX_NODES) {
+                    std::cerr << "The N of --numa-node must be the number";
+                    std::cerr << " of a node." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'x':
+                if (!parse_sched_policy(optarg, options.m_sched_policy)) {
+                    std::cerr << "Unknown scheduling policy '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'W':
+                options.m_spread_numa = true;
+                break;
+            case 'C':
+                if (!parse_duration(optarg, options.m_cpu_timeout_ns)
+                        || options.m_cpu_timeout_ns == 0) {
+                    std::cerr << "The DURATION of --cpu-timeout must be";
+                    std::cerr << " such as 1500, 1.5s or 250us." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                if (options.m_cpu_timeout_ns == DURATION_INFINITE) {
+                    options.m_cpu_timeout_ns = 0;
+                }
+                break;
+            case 'i':
+                if (!parse_duration(optarg, options.m_idle_timeout_ns)
+                        || options.m_idle_timeout_ns == 0) {
+                    std::cerr << "The DURATION of --idle-timeout must be";
+                    std::cerr << " such as 1500, 1.5s or 250us." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                if (options.m_idle_timeout_ns == DURATION_INFINITE) {
+                    options.m_idle_timeout_ns = 0;
+                }
+                break;
+            case 'D':
+                daemon_path = optarg;
+                break;
+            case 'S':
+                submit_path = optarg;
+                break;
+            case 'l':
+                options.m_log_path = optarg;
+                break;
+            case 'M':
+                if (!parse_size(optarg, options.m_memory_limit)
+                        || options.m_memory_limit == 0) {
+                    std::cerr << "The BYTES of --memory-limit must be a";
+                    std::cerr << " positive size such as 512M." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'q':
+                options.m_quiet = true;
+                break;
+            case 't':
+                if (!parse_size(optarg, options.m_tail_bytes)
+                        || options.m_tail_bytes == 0) {
+                    std::cerr << "The BYTES of --tail must be a positive";
+                    std::cerr << " size such as 4096 or 64K." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 's':
+                if (!parse_signal(optarg, options.m_signal)) {
+                    std::cerr << "Unknown signal '" << optarg << "'.";
+                    std::cerr << std::endl;
+                    return EXIT_CANCELED;
+                }
+                signal_given = true;
+                break;
+            case 'E':
+                if (!parse_event_engine(optarg, options.m_engine)) {
+                    std::cerr << "Unknown event engine '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'P':
+                if (!parse_spawn_strategy(optarg, options.m_spawn)) {
+                    std::cerr << "Unknown spawn strategy '" << optarg;
+                    std::cerr << "'." << std::endl;
+                    return EXIT_CANCELED;
+                }
+                break;
+            case 'v':
+                options.m_verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_CANCELED;
+        }
+    }
+
+    // A grace period only makes sense with a signal that can be caught.
+    if (!signal_given && options.m_kill_after_ns != 0) {
+        options.m_signal = SIGTERM;
+    }
+
+    if (daemon_path != NULL) {
+        if (optind != argc || manifest_path != NULL || submit_path != NULL) {
+            usage(argv[0]);
+            return EXIT_CANCELED;
+        }
+        return run_daemon(daemon_path, options);
+    }
+
+    if (manifest_path != NULL) {
+        if (optind != argc) {
+            usage(argv[0]);
+            return EXIT_CANCELED;
+        }
+
+        std::string manifest;
+        if (!read_file(manifest_path, manifest)) {
+            std::cerr << "Cannot read '" << manifest_path << "'." << std::endl;
+            return EXIT_CANCELED;
+        }
+
+        std::vector<Job> jobs;
+        std::string error;
+        if (!parse_manifest(manifest, delimiter, jobs, error)) {
+            std::cerr << error << std::endl;
+            return EXIT_CANCELED;
+        }
+
+        if (results_path == NULL) {
+            return run_batch(jobs, options, std::cerr);
+        }
+        std::ofstream results(results_path);
+        if (!results) {
+            std::cerr << "Cannot write '" << results_path << "'." << std::endl;
+            return EXIT_CANCELED;
+        }
+        return run_batch(jobs, options, results);
+    }
+
+    if (argc - optind < 2) {
+        usage(argv[0]);
+        return EXIT_CANCELED;
+    }
+
+    // Parse the TIMEOUT parameter
+    Job job;
+    if (!parse_duration(argv[optind], job.m_timeout_ns)) {
+        std::cerr << "The TIMEOUT must be a duration such as 1500, 1.5s";
+        std::cerr << " or 250us." << std::endl;
+        return EXIT_CANCELED;
+    }
+    job.m_argv.assign(argv + optind + 1, argv + argc);
+
+    if (submit_path != NULL) {
+        // The job runs in the daemon as if it was started from here.
+        char* cwd = getcwd(NULL, 0);
+        if (cwd != NULL) {
+            job.m_cwd = cwd;
+            free(cwd);
+        }
+        job.m_replace_env = true;
+        for (char** variable = environ; *variable != NULL; variable++) {
+            job.m_env.push_back(*variable);
+        }
+        return submit_job(submit_path, job);
+    }
+
+    return run_with_timeout(job, options).m_exit_code;
+}
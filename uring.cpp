@@ -0,0 +1,245 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+namespace tuxlike {
+
+IoUring::IoUring()
+    : m_fd(-1), m_rings(NULL), m_rings_size(0), m_sqes(NULL),
+      m_sqes_size(0), m_queued(0) {}
+
+IoUring::~IoUring() {
+    if (m_sqes != NULL) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_rings != NULL) {
+        munmap(m_rings, m_rings_size);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+int IoUring::open(unsigned entries) {
+    // Polls stay queued until they complete, so the completion ring
+    // is made larger than the submission ring. COOP_TASKRUN (5.19)
+    // spares us the interrupts of completions we harvest anyway.
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 16;
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0 && errno == EINVAL) {
+        params.flags &= ~IORING_SETUP_COOP_TASKRUN;
+        m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (m_fd < 0) {
+        return errno;
+    }
+
+    // Completions are waited for with a timeout (5.11), none is lost
+    // when the ring is full (5.5) and both rings share a mapping (5.4).
+    const uint32_t needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+        IORING_FEAT_EXT_ARG;
+    if ((params.features & needed) != needed) {
+        return ENOSYS;
+    }
+
+    m_rings_size = std::max<size_t>(
+        params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    void* rings = mmap(NULL, m_rings_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+        return errno;
+    }
+    m_rings = rings;
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return errno;
+    }
+    m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* base = static_cast<char*>(m_rings);
+    m_sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // Entries of the submission ring index the array of SQEs; we fill
+    // the SQEs in ring order, so the indirection is the identity.
+    unsigned* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+
+    // Updating a poll in place needs 5.13: older kernels reject the
+    // update of a poll that does not exist with EINVAL, not ENOENT.
+    int error = poll_update(IGNORED, 0);
+    if (error == 0) {
+        error = enter(UINT64_MAX);
+    }
+    struct io_uring_cqe cqe;
+    if (error == 0 && (!pop(cqe) || cqe.res == -EINVAL)) {
+        error = ENOSYS;
+    }
+    return error;
+}
+
+/**
+ * Claims the next SQE, submitting the queued ones first if the ring
+ * is full. The kernel only reads the ring within `io_uring_enter`, so
+ * the SQE may be filled in after the tail has moved past it.
+ *
+ * \return NULL if the ring is full and cannot be submitted.
+ */
+struct io_uring_sqe* IoUring::next_sqe() {
+    unsigned tail = *m_sq_tail;
+    if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+        if (submit() != 0 ||
+            tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &m_sqes[tail & m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    m_queued++;
+    return sqe;
+}
+
+int IoUring::submit() {
+    while (m_queued > 0) {
+        int submitted = syscall(__NR_io_uring_enter, m_fd, m_queued, 0, 0,
+            NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        m_queued -= submitted;
+    }
+    return 0;
+}
+
+int IoUring::poll_add(int fd, uint32_t events, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe();
+    if (sqe == NULL) {
+        return EBUSY;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int IoUring::poll_update(uint64_t user_data, uint32_t events) {
+    struct io_uring_sqe* sqe = next_sqe();
+    if (sqe == NULL) {
+        return EBUSY;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->len = IORING_POLL_UPDATE_EVENTS;
+    sqe->poll32_events = events;
+    sqe->user_data = IGNORED;
+    return 0;
+}
+
+int IoUring::poll_remove(uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe();
+    if (sqe == NULL) {
+        return EBUSY;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = IGNORED;
+    return 0;
+}
+
+int IoUring::enter(uint64_t timeout_ns) {
+    bool ready = ready_count() > 0;
+    if (ready && m_queued == 0) {
+        return 0;
+    }
+
+    // GETEVENTS without a wait still runs the pending completions.
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    unsigned wait = ready || timeout_ns == 0 ? 0 : 1;
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait && timeout_ns != UINT64_MAX) {
+        timeout.tv_sec = timeout_ns / 1000000000ULL;
+        timeout.tv_nsec = timeout_ns % 1000000000ULL;
+        arg.ts = reinterpret_cast<uintptr_t>(&timeout);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int submitted = syscall(__NR_io_uring_enter, m_fd, m_queued, wait, flags,
+        flags & IORING_ENTER_EXT_ARG ? &arg : NULL, sizeof(arg));
+    if (submitted < 0) {
+        // A failed wait is reported only if nothing was submitted.
+        if (errno == ETIME || errno == EINTR) {
+            return 0;
+        }
+        return errno;
+    }
+    m_queued -= submitted;
+    return 0;
+}
+
+unsigned IoUring::ready_count() const {
+    return __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) - *m_cq_head;
+}
+
+bool IoUring::pop(struct io_uring_cqe& cqe) {
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    cqe = m_cqes[head & m_cq_mask];
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+} // namespace tuxlike
@@ -0,0 +1,127 @@
+// Copyright (c) 2018 Radomír Černoch
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+namespace tuxlike {
+
+/**
+ * A minimal io_uring, set up and driven through the raw system calls.
+ *
+ * Operations are queued in the submission ring without a system call;
+ * `enter` submits all of them and waits for completions in one, and
+ * `pop` takes completions from the completion ring without any.
+ * A ring is used by a single thread.
+ */
+class IoUring {
+public:
+
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * Sets up a ring for `entries` queued operations.
+     *
+     * \return 0 on success, or the `errno` describing the failure;
+     *         ENOSYS if the kernel lacks io_uring or a feature we need
+     *         (it takes Linux 5.13, for `poll_update`).
+     */
+    int open(unsigned entries);
+
+    /**
+     * Queues a one-shot poll of `fd` for `events` (POLLIN, ...), whose
+     * completion carries `user_data` and the ready events.
+     *
+     * \return 0 on success, or the `errno` of submitting the queue
+     *         to make room.
+     */
+    int poll_add(int fd, uint32_t events, uint64_t user_data);
+
+    /**
+     * Queues a change of the events of the poll with `user_data`.
+     * Completes with ENOENT if that poll completed in the meantime.
+     */
+    int poll_update(uint64_t user_data, uint32_t events);
+
+    /// Queues the removal of the poll with `user_data`.
+    int poll_remove(uint64_t user_data);
+
+    /**
+     * Submits the queued operations and, unless some completions are
+     * ready already, waits for one at most `timeout_ns` nanoseconds.
+     *
+     * \return 0 on success, also if the wait timed out or was
+     *         interrupted, or the `errno` describing the failure.
+     */
+    int enter(uint64_t timeout_ns);
+
+    /// How many completions are ready to `pop`.
+    unsigned ready_count() const;
+
+    /**
+     * Takes the oldest completion from the ring.
+     *
+     * \return false if there is none.
+     */
+    bool pop(struct io_uring_cqe& cqe);
+
+    /// `user_data` of operations whose completion is of no interest.
+    static const uint64_t IGNORED = 0;
+
+private:
+
+    struct io_uring_sqe* next_sqe();
+    int submit();
+
+    int m_fd;
+
+    void* m_rings;
+    size_t m_rings_size;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    /// Queued operations not yet submitted.
+    unsigned m_queued;
+};
+
+} // namespace tuxlike
+
+#endif // URING_H